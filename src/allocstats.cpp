@@ -0,0 +1,145 @@
+//
+//  Copyright (c) 2026 plan44.ch / Lukas Zeller, Zurich, Switzerland
+//
+//  Author: Lukas Zeller <luz@plan44.ch>
+//
+//  This file is part of p44featured.
+//
+//  p44featured is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  p44featured is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with p44featured. If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "allocstats.hpp"
+
+using namespace p44;
+
+#if ENABLE_ALLOCSTATS
+
+#include <atomic>
+#include <new>
+#include <cstdlib>
+
+// constant initialized, so counting works for allocations made by static constructors
+// - size_t: word size atomics are lock free everywhere, 64-bit ones would need libatomic on 32-bit MIPS
+static std::atomic<size_t> gAllocations(0);
+static std::atomic<size_t> gDeallocations(0);
+static std::atomic<size_t> gBytes(0);
+
+
+size_t AllocStats::allocations()
+{
+  return gAllocations.load(std::memory_order_relaxed);
+}
+
+
+size_t AllocStats::deallocations()
+{
+  return gDeallocations.load(std::memory_order_relaxed);
+}
+
+
+size_t AllocStats::bytes()
+{
+  return gBytes.load(std::memory_order_relaxed);
+}
+
+
+// MARK: - replacement global allocation functions
+
+static inline void *countedAlloc(size_t aSize)
+{
+  gAllocations.fetch_add(1, std::memory_order_relaxed);
+  gBytes.fetch_add(aSize, std::memory_order_relaxed);
+  return malloc(aSize>0 ? aSize : 1);
+}
+
+
+static inline void countedFree(void *aPtr)
+{
+  if (!aPtr) return;
+  gDeallocations.fetch_add(1, std::memory_order_relaxed);
+  free(aPtr);
+}
+
+
+void *operator new(size_t aSize)
+{
+  void *p = countedAlloc(aSize);
+  if (!p) throw std::bad_alloc();
+  return p;
+}
+
+
+void *operator new[](size_t aSize)
+{
+  void *p = countedAlloc(aSize);
+  if (!p) throw std::bad_alloc();
+  return p;
+}
+
+
+void *operator new(size_t aSize, const std::nothrow_t &) throw()
+{
+  return countedAlloc(aSize);
+}
+
+
+void *operator new[](size_t aSize, const std::nothrow_t &) throw()
+{
+  return countedAlloc(aSize);
+}
+
+
+void operator delete(void *aPtr) throw()
+{
+  countedFree(aPtr);
+}
+
+
+void operator delete[](void *aPtr) throw()
+{
+  countedFree(aPtr);
+}
+
+
+void operator delete(void *aPtr, const std::nothrow_t &) throw()
+{
+  countedFree(aPtr);
+}
+
+
+void operator delete[](void *aPtr, const std::nothrow_t &) throw()
+{
+  countedFree(aPtr);
+}
+
+#else // ENABLE_ALLOCSTATS
+
+size_t AllocStats::allocations()
+{
+  return 0;
+}
+
+
+size_t AllocStats::deallocations()
+{
+  return 0;
+}
+
+
+size_t AllocStats::bytes()
+{
+  return 0;
+}
+
+#endif // !ENABLE_ALLOCSTATS
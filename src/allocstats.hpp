@@ -0,0 +1,58 @@
+//
+//  Copyright (c) 2026 plan44.ch / Lukas Zeller, Zurich, Switzerland
+//
+//  Author: Lukas Zeller <luz@plan44.ch>
+//
+//  This file is part of p44featured.
+//
+//  p44featured is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  p44featured is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with p44featured. If not, see <http://www.gnu.org/licenses/>.
+//
+
+#ifndef __p44featured__allocstats__
+#define __p44featured__allocstats__
+
+#include <stddef.h>
+
+#ifndef ENABLE_ALLOCSTATS
+  #define ENABLE_ALLOCSTATS 0 // replaces global operator new/delete, enable with --enable-allocstats
+#endif
+
+namespace p44 {
+
+  /// Counts heap allocations made via C++ operator new (all threads).
+  /// Allocations json-c or other C libraries make via malloc() directly are not counted.
+  /// @note only counts when built with ENABLE_ALLOCSTATS, otherwise all counters stay 0.
+  /// @note counters are word sized (lock free atomics on 32-bit targets, too) and wrap around there,
+  ///   so only differences between two readings are meaningful.
+  class AllocStats
+  {
+  public:
+
+    /// @return true if allocations are counted in this build
+    static bool enabled() { return ENABLE_ALLOCSTATS; }
+
+    /// @return number of operator new calls since process start
+    static size_t allocations();
+
+    /// @return number of operator delete calls (with non-NULL pointer) since process start
+    static size_t deallocations();
+
+    /// @return number of bytes requested via operator new since process start
+    static size_t bytes();
+
+  };
+
+} // namespace p44
+
+#endif /* defined(__p44featured__allocstats__) */
@@ -0,0 +1,315 @@
+//
+//  Copyright (c) 2026 plan44.ch / Lukas Zeller, Zurich, Switzerland
+//
+//  Author: Lukas Zeller <luz@plan44.ch>
+//
+//  This file is part of p44featured.
+//
+//  p44featured is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  p44featured is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with p44featured. If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "asynclogwriter.hpp"
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+
+using namespace p44;
+
+#define CRASH_FLUSH_GRACE_NS (4*1000*1000) // 4mS for the writer thread to finish its current write
+#define CRASH_FLUSH_POLL_NS (100*1000) // check for the writer to release the buffer every 100uS
+#define WRITER_BUFFER_SIZE 8192
+
+
+AsyncLogWriter::AsyncLogWriter() :
+  mSlots(NULL),
+  mMask(0),
+  mEnqueuePos(0),
+  mDequeuePos(0),
+  mDropped(0),
+  mDroppedReported(0),
+  mWritten(0),
+  mTerminate(false),
+  mFlushing(false),
+  mWriterIdle(false),
+  mDraining(false),
+  mRunning(false),
+  mOutFd(STDOUT_FILENO)
+{
+  mWakePipe[0] = -1;
+  mWakePipe[1] = -1;
+}
+
+
+AsyncLogWriter &AsyncLogWriter::sharedWriter()
+{
+  static AsyncLogWriter writer;
+  return writer;
+}
+
+
+void AsyncLogWriter::start(size_t aBufferSize, int aOutFd)
+{
+  if (mRunning) return;
+  size_t n = 16;
+  while (n*sizeof(Slot)<aBufferSize) n <<= 1;
+  mSlots = new Slot[n];
+  mMask = n-1;
+  for (size_t i=0; i<n; i++) mSlots[i].seq.store(i, std::memory_order_relaxed);
+  mEnqueuePos.store(0);
+  mDequeuePos = 0;
+  mOutFd = aOutFd;
+  mTerminate.store(false);
+  mWriterIdle.store(false);
+  if (pipe(mWakePipe)!=0) {
+    LOG(LOG_ERR, "cannot create async log writer wakeup pipe, logging remains synchronous");
+    delete[] mSlots;
+    mSlots = NULL;
+    return;
+  }
+  // producers must never block on the wakeup
+  fcntl(mWakePipe[1], F_SETFL, fcntl(mWakePipe[1], F_GETFL) | O_NONBLOCK);
+  if (pthread_create(&mWriterThread, NULL, &AsyncLogWriter::writerThread, this)!=0) {
+    LOG(LOG_ERR, "cannot start async log writer thread, logging remains synchronous");
+    close(mWakePipe[0]);
+    close(mWakePipe[1]);
+    delete[] mSlots;
+    mSlots = NULL;
+    return;
+  }
+  mRunning = true;
+  // make sure buffered lines get out when we crash
+  struct sigaction sa;
+  memset(&sa, 0, sizeof(sa));
+  sa.sa_handler = &AsyncLogWriter::fatalSignalHandler;
+  sa.sa_flags = SA_RESETHAND;
+  sigaction(SIGSEGV, &sa, NULL);
+  sigaction(SIGBUS, &sa, NULL);
+  sigaction(SIGILL, &sa, NULL);
+  sigaction(SIGFPE, &sa, NULL);
+  sigaction(SIGABRT, &sa, NULL);
+  globalLogger.setLogHandler(&AsyncLogWriter::logHandler, this);
+  LOG(LOG_NOTICE, "async logging enabled, %d slots of %d bytes", (int)n, (int)slotDataSize);
+}
+
+
+void AsyncLogWriter::stop()
+{
+  if (!mRunning) return;
+  globalLogger.setLogHandler(NULL, NULL);
+  mTerminate.store(true);
+  wakeWriter();
+  pthread_join(mWriterThread, NULL); // writer drains everything before exiting
+  close(mWakePipe[0]);
+  close(mWakePipe[1]);
+  mRunning = false;
+  if (mDropped.load()>0) {
+    LOG(LOG_WARNING, "async logging stopped, %lu lines written, %lu lines dropped", mWritten.load(), mDropped.load());
+  }
+}
+
+
+void AsyncLogWriter::logHandler(void *aContextPtr, int aLevel, const char *aLinePrefix, const char *aLogMessage)
+{
+  static_cast<AsyncLogWriter *>(aContextPtr)->push(aLinePrefix, aLogMessage);
+}
+
+
+void AsyncLogWriter::push(const char *aLinePrefix, const char *aLogMessage)
+{
+  size_t plen = aLinePrefix ? strlen(aLinePrefix) : 0;
+  size_t mlen = strlen(aLogMessage);
+  size_t total = plen+mlen+1; // plus newline
+  size_t chunks = (total+slotDataSize-1)/slotDataSize;
+  if (chunks>maxChunks) {
+    chunks = maxChunks;
+    total = maxChunks*slotDataSize;
+  }
+  if (chunks>mMask+1) {
+    // cannot ever fit
+    mDropped.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+  // reserve consecutive slots. As the consumer frees slots in order, the last one being free implies all are.
+  size_t pos = mEnqueuePos.load(std::memory_order_relaxed);
+  while (true) {
+    Slot &last = mSlots[(pos+chunks-1) & mMask];
+    intptr_t diff = (intptr_t)last.seq.load(std::memory_order_acquire) - (intptr_t)(pos+chunks-1);
+    if (diff==0) {
+      if (mEnqueuePos.compare_exchange_weak(pos, pos+chunks, std::memory_order_relaxed)) break;
+    }
+    else if (diff<0) {
+      // buffer full
+      mDropped.fetch_add(1, std::memory_order_relaxed);
+      return;
+    }
+    else {
+      pos = mEnqueuePos.load(std::memory_order_relaxed);
+    }
+  }
+  // copy text into the reserved slots
+  size_t done = 0;
+  for (size_t c=0; c<chunks; c++) {
+    Slot &slot = mSlots[(pos+c) & mMask];
+    size_t n = 0;
+    while (n<slotDataSize && done<total) {
+      if (done<plen) slot.data[n] = aLinePrefix[done];
+      else if (done<plen+mlen && done<total-1) slot.data[n] = aLogMessage[done-plen];
+      else slot.data[n] = '\n';
+      n++; done++;
+    }
+    slot.len = (uint16_t)n;
+    slot.chunks = (uint16_t)chunks;
+  }
+  // publish, last slot first, so the consumer finds a complete record once the first slot is published
+  for (size_t c=chunks; c>0; c--) {
+    mSlots[(pos+c-1) & mMask].seq.store(pos+c, std::memory_order_release);
+  }
+  // publishing must be visible before checking whether the writer went idle (pairs with the fence in writerThread)
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (mWriterIdle.load(std::memory_order_relaxed)) wakeWriter();
+}
+
+
+void AsyncLogWriter::wakeWriter()
+{
+  // only the first producer after the writer went idle writes to the pipe
+  if (mWriterIdle.exchange(false) || mTerminate.load()) {
+    char c = 0;
+    if (write(mWakePipe[1], &c, 1)<0) { /* pipe full means a wakeup is pending anyway */ }
+  }
+}
+
+
+bool AsyncLogWriter::pending()
+{
+  return
+    (intptr_t)mSlots[mDequeuePos & mMask].seq.load(std::memory_order_acquire)-(intptr_t)(mDequeuePos+1)==0 ||
+    mDropped.load()>mDroppedReported;
+}
+
+
+// async-signal-safe formatting helpers for drain(), which also runs in the crash handler (no stdio there)
+
+static size_t appendText(char *aBuffer, size_t aPos, size_t aBufSize, const char *aText)
+{
+  while (*aText && aPos<aBufSize) aBuffer[aPos++] = *aText++;
+  return aPos;
+}
+
+
+static size_t appendNumber(char *aBuffer, size_t aPos, size_t aBufSize, unsigned long aNumber)
+{
+  char digits[24];
+  size_t n = 0;
+  do { digits[n++] = '0'+aNumber%10; aNumber /= 10; } while (aNumber>0);
+  while (n>0 && aPos<aBufSize) aBuffer[aPos++] = digits[--n];
+  return aPos;
+}
+
+
+bool AsyncLogWriter::drain(char *aBuffer, size_t aBufSize, bool aCrashFlush)
+{
+  size_t used = 0;
+  bool any = false;
+  unsigned long dropped = mDropped.load();
+  if (dropped>mDroppedReported) {
+    used = appendText(aBuffer, used, aBufSize, "[");
+    used = appendNumber(aBuffer, used, aBufSize, dropped-mDroppedReported);
+    used = appendText(aBuffer, used, aBufSize, " log lines dropped, async log buffer full]\n");
+    mDroppedReported = dropped;
+  }
+  while (true) {
+    if (!aCrashFlush && mFlushing.load()) break; // crash handler is waiting to take over
+    Slot &first = mSlots[mDequeuePos & mMask];
+    if ((intptr_t)first.seq.load(std::memory_order_acquire)-(intptr_t)(mDequeuePos+1)!=0) break; // nothing (complete) available
+    size_t chunks = first.chunks;
+    if (used+chunks*slotDataSize>aBufSize) {
+      if (used>0) {
+        // flush what we have to make room
+        if (write(mOutFd, aBuffer, used)<0) { /* nothing we can do */ }
+        used = 0;
+      }
+    }
+    for (size_t c=0; c<chunks; c++) {
+      Slot &slot = mSlots[(mDequeuePos+c) & mMask];
+      memcpy(aBuffer+used, slot.data, slot.len);
+      used += slot.len;
+      // free the slot for the next round
+      slot.seq.store(mDequeuePos+c+mMask+1, std::memory_order_release);
+    }
+    mDequeuePos += chunks;
+    mWritten.fetch_add(1, std::memory_order_relaxed);
+    any = true;
+  }
+  if (used>0) {
+    if (write(mOutFd, aBuffer, used)<0) { /* nothing we can do */ }
+  }
+  return any;
+}
+
+
+void *AsyncLogWriter::writerThread(void *aArg)
+{
+  AsyncLogWriter *w = static_cast<AsyncLogWriter *>(aArg);
+  char *buffer = new char[WRITER_BUFFER_SIZE+maxChunks*slotDataSize];
+  while (true) {
+    bool terminate = w->mTerminate.load();
+    if (w->mFlushing.load()) break; // crash handler has taken over
+    // consuming from two threads at once would duplicate or lose lines, so drain only as the owner
+    bool any = false;
+    if (!w->mDraining.exchange(true, std::memory_order_acquire)) {
+      any = w->drain(buffer, WRITER_BUFFER_SIZE+maxChunks*slotDataSize);
+      w->mDraining.store(false, std::memory_order_release);
+    }
+    if (!any) {
+      if (terminate) break;
+      // announce idle, then check again: a producer that published before seeing the flag did not wake us
+      w->mWriterIdle.store(true, std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      if (w->pending() || w->mTerminate.load()) {
+        w->mWriterIdle.store(false);
+        continue;
+      }
+      // block until a producer (or stop()) writes to the pipe, no periodic wakeups
+      char c;
+      if (read(w->mWakePipe[0], &c, 1)<0 && errno!=EINTR) break;
+    }
+  }
+  delete[] buffer;
+  return NULL;
+}
+
+
+void AsyncLogWriter::fatalSignalHandler(int aSignal)
+{
+  AsyncLogWriter &w = sharedWriter();
+  if (!w.mFlushing.exchange(true)) {
+    // wait (bounded) for the writer thread to finish the write it might be doing, then drain synchronously.
+    // If the writer does not let go in time (blocked on a slow device, or it is the crashing thread),
+    // the remaining lines are lost rather than written twice or out of order.
+    static char buffer[WRITER_BUFFER_SIZE+maxChunks*slotDataSize];
+    for (long waited = 0; waited<CRASH_FLUSH_GRACE_NS; waited += CRASH_FLUSH_POLL_NS) {
+      if (!w.mDraining.exchange(true, std::memory_order_acquire)) {
+        w.drain(buffer, sizeof(buffer), true); // ownership is never given back, the process terminates
+        break;
+      }
+      struct timespec ts = { 0, CRASH_FLUSH_POLL_NS };
+      nanosleep(&ts, NULL);
+    }
+  }
+  raise(aSignal); // handler was reset by SA_RESETHAND, so this terminates with the original signal
+}
@@ -0,0 +1,103 @@
+//
+//  Copyright (c) 2026 plan44.ch / Lukas Zeller, Zurich, Switzerland
+//
+//  Author: Lukas Zeller <luz@plan44.ch>
+//
+//  This file is part of p44featured.
+//
+//  p44featured is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  p44featured is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with p44featured. If not, see <http://www.gnu.org/licenses/>.
+//
+
+#ifndef __p44featured__asynclogwriter__
+#define __p44featured__asynclogwriter__
+
+#include "p44utils_common.hpp"
+
+#include <atomic>
+#include <pthread.h>
+
+using namespace std;
+
+namespace p44 {
+
+  /// Writes log output from a background thread.
+  /// Installed as the global logger's output handler, it copies each log line into a lock-free
+  /// multi-producer ring buffer, so threads calling LOG() never block on the output device.
+  /// Lines that do not fit into the buffer are dropped and counted.
+  /// On fatal signals, the buffer is flushed synchronously before the process terminates.
+  class AsyncLogWriter
+  {
+    static const size_t slotDataSize = 112;
+    static const size_t maxChunks = 64; ///< longer lines are truncated
+
+    struct Slot {
+      std::atomic<size_t> seq;
+      uint16_t chunks; ///< number of slots used by the record (first slot only)
+      uint16_t len; ///< number of valid bytes in data of this slot
+      char data[slotDataSize];
+    };
+
+    Slot *mSlots;
+    size_t mMask;
+    std::atomic<size_t> mEnqueuePos;
+    size_t mDequeuePos; ///< only touched by the consumer (or the crash handler)
+    std::atomic<unsigned long> mDropped;
+    unsigned long mDroppedReported; ///< only touched by the consumer
+    std::atomic<unsigned long> mWritten;
+    std::atomic<bool> mTerminate;
+    std::atomic<bool> mFlushing;
+    std::atomic<bool> mWriterIdle; ///< set while the writer waits for the wakeup pipe
+    std::atomic<bool> mDraining; ///< owner flag, only one thread (writer or crash handler) may drain at a time
+    int mWakePipe[2]; ///< producers write a byte to wake an idle writer
+    pthread_t mWriterThread;
+    bool mRunning;
+    int mOutFd;
+
+    AsyncLogWriter();
+
+  public:
+
+    /// @return the shared instance
+    static AsyncLogWriter &sharedWriter();
+
+    /// start asynchronous logging
+    /// @param aBufferSize size of the ring buffer in bytes (rounded up to a power of 2 number of slots)
+    /// @param aOutFd the file descriptor to write log lines to
+    void start(size_t aBufferSize, int aOutFd);
+
+    /// write out all buffered lines and revert to synchronous logging
+    void stop();
+
+    /// @return number of lines dropped because the buffer was full
+    unsigned long dropped() const { return mDropped.load(); }
+
+    /// @return number of lines written
+    unsigned long written() const { return mWritten.load(); }
+
+  private:
+
+    static void logHandler(void *aContextPtr, int aLevel, const char *aLinePrefix, const char *aLogMessage);
+    static void *writerThread(void *aArg);
+    static void fatalSignalHandler(int aSignal);
+
+    void push(const char *aLinePrefix, const char *aLogMessage);
+    bool drain(char *aBuffer, size_t aBufSize, bool aCrashFlush = false);
+    bool pending();
+    void wakeWriter();
+
+  };
+
+} // namespace p44
+
+#endif /* defined(__p44featured__asynclogwriter__) */
@@ -0,0 +1,312 @@
+//
+//  Copyright (c) 2026 plan44.ch / Lukas Zeller, Zurich, Switzerland
+//
+//  Author: Lukas Zeller <luz@plan44.ch>
+//
+//  This file is part of p44featured.
+//
+//  p44featured is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  p44featured is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with p44featured. If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "binjson.hpp"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+using namespace p44;
+
+#define BINJSON_MAGIC "p44j"
+#define BINJSON_VERSION 2 // 2: doubles in defined (little endian) byte order
+#define BINJSON_MAX_DEPTH 64
+
+enum {
+  tag_null,
+  tag_false,
+  tag_true,
+  tag_int,
+  tag_double,
+  tag_string,
+  tag_array,
+  tag_object
+};
+
+
+// MARK: - encoding
+
+static void putVarUInt(string &aBin, uint64_t aVal)
+{
+  while (aVal>=0x80) {
+    aBin.push_back((char)((aVal & 0x7F) | 0x80));
+    aVal >>= 7;
+  }
+  aBin.push_back((char)aVal);
+}
+
+
+static void putBytes(string &aBin, const char *aBytes, size_t aLen)
+{
+  putVarUInt(aBin, aLen);
+  aBin.append(aBytes, aLen);
+}
+
+
+void BinJson::encode(JsonObjectPtr aJson, string &aBinary)
+{
+  if (!aJson) {
+    aBinary.push_back(tag_null);
+    return;
+  }
+  switch (aJson->type()) {
+    case json_type_boolean:
+      aBinary.push_back(aJson->boolValue() ? tag_true : tag_false);
+      break;
+    case json_type_int: {
+      int64_t v = aJson->int64Value();
+      aBinary.push_back(tag_int);
+      putVarUInt(aBinary, ((uint64_t)v<<1) ^ (uint64_t)(v>>63)); // zigzag, small negative numbers stay short
+      break;
+    }
+    case json_type_double: {
+      double d = aJson->doubleValue();
+      uint64_t bits;
+      memcpy(&bits, &d, sizeof(bits));
+      aBinary.push_back(tag_double);
+      for (int i=0; i<8; i++) {
+        aBinary.push_back((char)(bits & 0xFF)); // little endian, independent of host byte order
+        bits >>= 8;
+      }
+      break;
+    }
+    case json_type_string:
+      aBinary.push_back(tag_string);
+      putBytes(aBinary, aJson->c_strValue(), aJson->stringLength());
+      break;
+    case json_type_array: {
+      int n = aJson->arrayLength();
+      aBinary.push_back(tag_array);
+      putVarUInt(aBinary, n);
+      for (int i=0; i<n; i++) encode(aJson->arrayGet(i), aBinary);
+      break;
+    }
+    case json_type_object: {
+      // count first, as size is needed upfront
+      int n = 0;
+      string key;
+      JsonObjectPtr val;
+      aJson->resetKeyIteration();
+      while (aJson->nextKeyValue(key, val)) n++;
+      aBinary.push_back(tag_object);
+      putVarUInt(aBinary, n);
+      aJson->resetKeyIteration();
+      while (aJson->nextKeyValue(key, val)) {
+        putBytes(aBinary, key.c_str(), key.size());
+        encode(val, aBinary);
+      }
+      break;
+    }
+    default:
+      aBinary.push_back(tag_null);
+      break;
+  }
+}
+
+
+// MARK: - decoding
+
+namespace {
+
+  class BinJsonDecoder
+  {
+    const uint8_t *mP;
+    const uint8_t *mEnd;
+
+  public:
+
+    BinJsonDecoder(const uint8_t *aData, size_t aSize) : mP(aData), mEnd(aData+aSize) {};
+
+    bool atEnd() { return mP>=mEnd; }
+
+    bool varUInt(uint64_t &aVal)
+    {
+      aVal = 0;
+      for (int shift=0; shift<64; shift+=7) {
+        if (mP>=mEnd) return false;
+        uint8_t b = *mP++;
+        aVal |= (uint64_t)(b & 0x7F)<<shift;
+        if ((b & 0x80)==0) return true;
+      }
+      return false;
+    }
+
+    bool bytes(const char *&aBytes, size_t &aLen)
+    {
+      uint64_t len;
+      if (!varUInt(len) || len>(uint64_t)(mEnd-mP)) return false;
+      aBytes = (const char *)mP;
+      aLen = (size_t)len;
+      mP += len;
+      return true;
+    }
+
+    bool value(JsonObjectPtr &aJson, int aDepth)
+    {
+      if (mP>=mEnd || aDepth>BINJSON_MAX_DEPTH) return false;
+      uint8_t tag = *mP++;
+      switch (tag) {
+        case tag_null: aJson.reset(); return true;
+        case tag_false: aJson = JsonObject::newBool(false); return true;
+        case tag_true: aJson = JsonObject::newBool(true); return true;
+        case tag_int: {
+          uint64_t z;
+          if (!varUInt(z)) return false;
+          aJson = JsonObject::newInt64((int64_t)(z>>1) ^ -(int64_t)(z & 1));
+          return true;
+        }
+        case tag_double: {
+          if (mEnd-mP<8) return false;
+          uint64_t bits = 0;
+          for (int i=7; i>=0; i--) bits = (bits<<8) | mP[i];
+          mP += 8;
+          double d;
+          memcpy(&d, &bits, sizeof(d));
+          aJson = JsonObject::newDouble(d);
+          return true;
+        }
+        case tag_string: {
+          const char *s;
+          size_t len;
+          if (!bytes(s, len)) return false;
+          aJson = JsonObject::newString(s, len);
+          return true;
+        }
+        case tag_array: {
+          uint64_t n;
+          if (!varUInt(n) || n>(uint64_t)(mEnd-mP)) return false; // each element needs at least one byte
+          aJson = JsonObject::newArray();
+          for (uint64_t i=0; i<n; i++) {
+            JsonObjectPtr e;
+            if (!value(e, aDepth+1)) return false;
+            aJson->arrayAppend(e);
+          }
+          return true;
+        }
+        case tag_object: {
+          uint64_t n;
+          if (!varUInt(n) || n>(uint64_t)(mEnd-mP)) return false;
+          aJson = JsonObject::newObj();
+          for (uint64_t i=0; i<n; i++) {
+            const char *k;
+            size_t klen;
+            JsonObjectPtr v;
+            if (!bytes(k, klen) || !value(v, aDepth+1)) return false;
+            aJson->add(string(k, klen).c_str(), v);
+          }
+          return true;
+        }
+      }
+      return false;
+    }
+
+  };
+
+} // namespace
+
+
+ErrorPtr BinJson::decode(const uint8_t *aData, size_t aSize, JsonObjectPtr &aJson)
+{
+  BinJsonDecoder dec(aData, aSize);
+  if (!dec.value(aJson, 0) || !dec.atEnd()) {
+    aJson.reset();
+    return TextError::err("corrupt binary JSON data");
+  }
+  return ErrorPtr();
+}
+
+
+// MARK: - files
+
+ErrorPtr BinJson::saveFile(const string aPath, JsonObjectPtr aJson, const string aKey)
+{
+  string bin = BINJSON_MAGIC;
+  bin.push_back(BINJSON_VERSION);
+  putBytes(bin, aKey.c_str(), aKey.size());
+  encode(aJson, bin);
+  string tmpPath = aPath+".tmp";
+  int fd = open(tmpPath.c_str(), O_WRONLY|O_CREAT|O_TRUNC, 0644);
+  if (fd<0) return SysError::errNo("cannot create binary JSON file: ");
+  const char *p = bin.c_str();
+  size_t remaining = bin.size();
+  while (remaining>0) {
+    ssize_t n = write(fd, p, remaining);
+    if (n<0) {
+      if (errno==EINTR) continue;
+      ErrorPtr err = SysError::errNo("cannot write binary JSON file: ");
+      close(fd);
+      unlink(tmpPath.c_str());
+      return err;
+    }
+    p += n;
+    remaining -= n;
+  }
+  fsync(fd);
+  close(fd);
+  if (rename(tmpPath.c_str(), aPath.c_str())!=0) {
+    ErrorPtr err = SysError::errNo("cannot rename binary JSON file: ");
+    unlink(tmpPath.c_str());
+    return err;
+  }
+  return ErrorPtr();
+}
+
+
+ErrorPtr BinJson::loadFile(const string aPath, JsonObjectPtr &aJson, const string aKey)
+{
+  int fd = open(aPath.c_str(), O_RDONLY);
+  if (fd<0) return SysError::errNo("cannot open binary JSON file: ");
+  struct stat st;
+  if (fstat(fd, &st)!=0 || st.st_size==0) {
+    close(fd);
+    return TextError::err("empty binary JSON file");
+  }
+  void *m = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd); // mapping stays valid
+  if (m==MAP_FAILED) return SysError::errNo("cannot map binary JSON file: ");
+  ErrorPtr err;
+  const uint8_t *p = (const uint8_t *)m;
+  size_t sz = st.st_size;
+  size_t hdr = strlen(BINJSON_MAGIC);
+  if (sz<hdr+1 || memcmp(p, BINJSON_MAGIC, hdr)!=0 || p[hdr]!=BINJSON_VERSION) {
+    err = TextError::err("not a binary JSON file or wrong version");
+  }
+  else {
+    BinJsonDecoder dec(p+hdr+1, sz-hdr-1);
+    const char *key;
+    size_t keyLen;
+    if (!dec.bytes(key, keyLen)) {
+      err = TextError::err("corrupt binary JSON header");
+    }
+    else if (!aKey.empty() && aKey!=string(key, keyLen)) {
+      err = TextError::err("binary JSON file is outdated");
+    }
+    else {
+      const uint8_t *body = (const uint8_t *)key+keyLen;
+      err = decode(body, (p+sz)-body, aJson);
+    }
+  }
+  munmap(m, st.st_size);
+  return err;
+}
@@ -0,0 +1,70 @@
+//
+//  Copyright (c) 2026 plan44.ch / Lukas Zeller, Zurich, Switzerland
+//
+//  Author: Lukas Zeller <luz@plan44.ch>
+//
+//  This file is part of p44featured.
+//
+//  p44featured is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  p44featured is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with p44featured. If not, see <http://www.gnu.org/licenses/>.
+//
+
+#ifndef __p44featured__binjson__
+#define __p44featured__binjson__
+
+#include "p44utils_common.hpp"
+#include "jsonobject.hpp"
+
+using namespace std;
+
+namespace p44 {
+
+  /// Compact binary representation of JSON object trees.
+  /// Values are stored as a type tag followed by varint encoded lengths/integers, so
+  /// decoding needs no text scanning and no number conversion. Integers are zigzag varints, doubles
+  /// IEEE 754 binary64 in little endian byte order, so files can be moved between hosts.
+  /// Files start with a magic and a format version, and are read via mmap.
+  class BinJson
+  {
+  public:
+
+    /// append binary representation of a JSON object tree
+    /// @param aJson the JSON to encode
+    /// @param aBinary the binary representation is appended here
+    static void encode(JsonObjectPtr aJson, string &aBinary);
+
+    /// decode binary representation
+    /// @param aData start of the binary representation
+    /// @param aSize size of the binary data
+    /// @param aJson will receive the decoded JSON
+    /// @return ok or error when data is corrupt
+    static ErrorPtr decode(const uint8_t *aData, size_t aSize, JsonObjectPtr &aJson);
+
+    /// save as binary JSON file. File is written to a temp file and then renamed, so
+    /// readers never see a partially written file.
+    /// @param aPath file path
+    /// @param aJson the JSON to save
+    /// @param aKey optional key stored in the header, for checking validity when loading
+    static ErrorPtr saveFile(const string aPath, JsonObjectPtr aJson, const string aKey = "");
+
+    /// load binary JSON file
+    /// @param aPath file path
+    /// @param aJson will receive the decoded JSON
+    /// @param aKey if not empty, the file is only loaded when it was saved with the same key
+    static ErrorPtr loadFile(const string aPath, JsonObjectPtr &aJson, const string aKey = "");
+
+  };
+
+} // namespace p44
+
+#endif /* defined(__p44featured__binjson__) */
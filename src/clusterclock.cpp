@@ -0,0 +1,277 @@
+//
+//  Copyright (c) 2026 plan44.ch / Lukas Zeller, Zurich, Switzerland
+//
+//  Author: Lukas Zeller <luz@plan44.ch>
+//
+//  This file is part of p44featured.
+//
+//  p44featured is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  p44featured is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with p44featured. If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "clusterclock.hpp"
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+using namespace p44;
+
+#define BEACON_INTERVAL (100*MilliSecond)
+#define BEACON_TIMEOUT (2*Second) // followers fall back to local time without beacons
+#define BEACON_MAGIC 0x50343443 // "P44C"
+#define BEACON_VERSION 1
+#define MAX_FRAME_INTERVAL (10*Second) // beacons with longer (or non-positive) frame intervals are rejected
+
+// all fields in network byte order, 64-bit values as two 32-bit words, most significant first
+struct Beacon {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t seq;
+  uint32_t reserved;
+  uint32_t masterTime[2]; ///< master's mainloop time when sending
+  uint32_t epoch[2]; ///< start of frame 0 in master time
+  uint32_t frameInterval[2];
+};
+
+
+// portable replacements for htobe64/be64toh, which are not available on all platforms
+static void putInt64(uint32_t aWords[2], int64_t aValue)
+{
+  aWords[0] = htonl((uint32_t)((uint64_t)aValue>>32));
+  aWords[1] = htonl((uint32_t)aValue);
+}
+
+
+static int64_t getInt64(const uint32_t aWords[2])
+{
+  return (int64_t)(((uint64_t)ntohl(aWords[0])<<32) | ntohl(aWords[1]));
+}
+
+
+ClusterClock::ClusterClock(bool aMaster, const string aGroup, int aPort, MLMicroSeconds aFrameInterval, const string aInterface) :
+  mMaster(aMaster),
+  mGroup(aGroup),
+  mPort(aPort),
+  mInterface(aInterface),
+  mFd(-1),
+  mSeq(0),
+  mFrameInterval(aFrameInterval>0 ? aFrameInterval : 20*MilliSecond),
+  mEpoch(MainLoop::now()),
+  mOffset(0),
+  mNumSamples(0),
+  mNextSample(0),
+  mLastBeacon(Never),
+  mBeacons(0),
+  mRejected(0)
+{
+}
+
+
+ClusterClock::~ClusterClock()
+{
+  stop();
+}
+
+
+ErrorPtr ClusterClock::start()
+{
+  struct in_addr group;
+  if (inet_aton(mGroup.c_str(), &group)==0 || !IN_MULTICAST(ntohl(group.s_addr))) {
+    return TextError::err("invalid cluster multicast group '%s'", mGroup.c_str());
+  }
+  struct in_addr ifaddr;
+  ifaddr.s_addr = htonl(INADDR_ANY);
+  if (!mInterface.empty() && inet_aton(mInterface.c_str(), &ifaddr)==0) {
+    return TextError::err("invalid cluster interface address '%s'", mInterface.c_str());
+  }
+  mFd = socket(AF_INET, SOCK_DGRAM, 0);
+  if (mFd<0) return SysError::errNo("cluster socket: ");
+  // several nodes on the same host must be able to share the port
+  int one = 1;
+  setsockopt(mFd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+  #ifdef SO_REUSEPORT
+  setsockopt(mFd, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one));
+  #endif
+  unsigned char loop = 1; // followers on the master's host must see the beacons, too
+  setsockopt(mFd, IPPROTO_IP, IP_MULTICAST_LOOP, &loop, sizeof(loop));
+  unsigned char ttl = 1;
+  setsockopt(mFd, IPPROTO_IP, IP_MULTICAST_TTL, &ttl, sizeof(ttl));
+  if (!mInterface.empty()) {
+    setsockopt(mFd, IPPROTO_IP, IP_MULTICAST_IF, &ifaddr, sizeof(ifaddr));
+  }
+  ErrorPtr err;
+  if (!mMaster) {
+    struct sockaddr_in sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sin_family = AF_INET;
+    sa.sin_port = htons(mPort);
+    sa.sin_addr.s_addr = htonl(INADDR_ANY);
+    struct ip_mreq mreq;
+    mreq.imr_multiaddr = group;
+    mreq.imr_interface = ifaddr;
+    if (bind(mFd, (struct sockaddr *)&sa, sizeof(sa))<0) {
+      err = SysError::errNo("cluster bind: ");
+    }
+    else if (setsockopt(mFd, IPPROTO_IP, IP_ADD_MEMBERSHIP, &mreq, sizeof(mreq))<0) {
+      err = SysError::errNo("cluster join group: ");
+    }
+  }
+  if (Error::notOK(err)) {
+    close(mFd);
+    mFd = -1;
+    return err;
+  }
+  fcntl(mFd, F_SETFL, fcntl(mFd, F_GETFL) | O_NONBLOCK);
+  if (mMaster) {
+    mBeaconTicket.executeOnce(boost::bind(&ClusterClock::sendBeacon, this));
+  }
+  else {
+    MainLoop::currentMainLoop().registerPollHandler(mFd, POLLIN, boost::bind(&ClusterClock::beaconReceived, this, _1, _2));
+  }
+  LOG(LOG_NOTICE, "cluster clock started as %s on %s:%d, frame interval %lld uS", mMaster ? "master" : "follower", mGroup.c_str(), mPort, (long long)mFrameInterval);
+  return ErrorPtr();
+}
+
+
+void ClusterClock::stop()
+{
+  mBeaconTicket.cancel();
+  if (mFd>=0) {
+    if (!mMaster) MainLoop::currentMainLoop().unregisterPollHandler(mFd);
+    close(mFd);
+    mFd = -1;
+  }
+}
+
+
+string ClusterClock::beacon(uint32_t aSeq, MLMicroSeconds aMasterTime, MLMicroSeconds aEpoch, MLMicroSeconds aFrameInterval)
+{
+  Beacon b;
+  b.magic = htonl(BEACON_MAGIC);
+  b.version = htonl(BEACON_VERSION);
+  b.seq = htonl(aSeq);
+  b.reserved = 0;
+  putInt64(b.masterTime, aMasterTime);
+  putInt64(b.epoch, aEpoch);
+  putInt64(b.frameInterval, aFrameInterval);
+  return string((const char *)&b, sizeof(b));
+}
+
+
+void ClusterClock::sendBeacon()
+{
+  struct sockaddr_in sa;
+  memset(&sa, 0, sizeof(sa));
+  sa.sin_family = AF_INET;
+  sa.sin_port = htons(mPort);
+  inet_aton(mGroup.c_str(), &sa.sin_addr);
+  string b = beacon(++mSeq, MainLoop::now(), mEpoch, mFrameInterval); // time as late as possible
+  if (sendto(mFd, b.data(), b.size(), 0, (struct sockaddr *)&sa, sizeof(sa))<0) {
+    LOG(LOG_WARNING, "cluster beacon could not be sent: %s", strerror(errno));
+  }
+  mBeaconTicket.executeOnce(boost::bind(&ClusterClock::sendBeacon, this), BEACON_INTERVAL);
+}
+
+
+bool ClusterClock::beaconReceived(int aFD, int aPollFlags)
+{
+  Beacon b;
+  ssize_t n;
+  while ((n = recv(mFd, &b, sizeof(b), 0))>0) {
+    processBeacon(&b, n, MainLoop::now());
+  }
+  return true;
+}
+
+
+bool ClusterClock::processBeacon(const void *aData, size_t aSize, MLMicroSeconds aReceivedAt)
+{
+  Beacon b;
+  if (aSize!=sizeof(b)) return false;
+  memcpy(&b, aData, sizeof(b));
+  if (ntohl(b.magic)!=BEACON_MAGIC || ntohl(b.version)!=BEACON_VERSION) return false;
+  MLMicroSeconds masterTime = getInt64(b.masterTime);
+  MLMicroSeconds epoch = getInt64(b.epoch);
+  MLMicroSeconds frameInterval = getInt64(b.frameInterval);
+  // validate before using anything, a zero frame interval would divide by zero in frameAt()
+  if (frameInterval<=0 || frameInterval>MAX_FRAME_INTERVAL || epoch<0 || epoch>masterTime) {
+    if (mRejected++==0) {
+      LOG(LOG_WARNING, "cluster beacon rejected: epoch=%lld, frameinterval=%lld, mastertime=%lld", (long long)epoch, (long long)frameInterval, (long long)masterTime);
+    }
+    return false;
+  }
+  if (epoch!=mEpoch && mNumSamples>0) {
+    // master restarted, its time base has changed, old offset samples are meaningless
+    mNumSamples = 0;
+    mNextSample = 0;
+  }
+  bool changed = epoch!=mEpoch || frameInterval!=mFrameInterval;
+  mEpoch = epoch;
+  mFrameInterval = frameInterval;
+  // The sample is the true offset minus the transmission delay. Taking the maximum over
+  // the window picks the beacon with the least delay, which filters out network jitter.
+  mSamples[mNextSample] = masterTime-aReceivedAt;
+  mNextSample = (mNextSample+1) % offsetWindow;
+  if (mNumSamples<offsetWindow) mNumSamples++;
+  MLMicroSeconds best = mSamples[0];
+  for (int i=1; i<mNumSamples; i++) {
+    if (mSamples[i]>best) best = mSamples[i];
+  }
+  if (best!=mOffset) changed = true;
+  mOffset = best;
+  mLastBeacon = aReceivedAt;
+  mBeacons++;
+  if (changed && mChangeCB) mChangeCB();
+  return true;
+}
+
+
+bool ClusterClock::synchronized()
+{
+  return mMaster || (mLastBeacon!=Never && MainLoop::now()-mLastBeacon<BEACON_TIMEOUT);
+}
+
+
+int64_t ClusterClock::frameAt(MLMicroSeconds aLocalTime)
+{
+  MLMicroSeconds t = aLocalTime+mOffset-mEpoch;
+  int64_t f = t/mFrameInterval;
+  if (t<0 && t%mFrameInterval!=0) f--; // floor
+  return f;
+}
+
+
+JsonObjectPtr ClusterClock::stats()
+{
+  JsonObjectPtr s = JsonObject::newObj();
+  s->add("role", JsonObject::newString(mMaster ? "master" : "follower"));
+  s->add("synchronized", JsonObject::newBool(synchronized()));
+  s->add("frame", JsonObject::newInt64(frameAt(MainLoop::now())));
+  s->add("frameinterval_us", JsonObject::newInt64(mFrameInterval));
+  if (!mMaster) {
+    s->add("offset_us", JsonObject::newInt64(mOffset));
+    s->add("beacons", JsonObject::newInt64(mBeacons));
+    s->add("rejected", JsonObject::newInt64(mRejected));
+    if (mNumSamples>0) {
+      // spread of the offset samples, i.e. the delay jitter
+      MLMicroSeconds lo = mSamples[0];
+      for (int i=1; i<mNumSamples; i++) if (mSamples[i]<lo) lo = mSamples[i];
+      s->add("jitter_us", JsonObject::newInt64(mOffset-lo));
+    }
+  }
+  return s;
+}
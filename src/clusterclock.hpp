@@ -0,0 +1,142 @@
+//
+//  Copyright (c) 2026 plan44.ch / Lukas Zeller, Zurich, Switzerland
+//
+//  Author: Lukas Zeller <luz@plan44.ch>
+//
+//  This file is part of p44featured.
+//
+//  p44featured is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  p44featured is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with p44featured. If not, see <http://www.gnu.org/licenses/>.
+//
+
+#ifndef __p44featured__clusterclock__
+#define __p44featured__clusterclock__
+
+#include "p44utils_common.hpp"
+#include "jsonobject.hpp"
+
+using namespace std;
+
+namespace p44 {
+
+  class ClusterClock;
+  typedef boost::intrusive_ptr<ClusterClock> ClusterClockPtr;
+
+  /// Frame clock shared by several p44featured nodes.
+  /// The master multicasts beacons with its mainloop time, the frame epoch and the frame interval.
+  /// Followers estimate the offset between their own and the master's mainloop time, so all nodes
+  /// agree on frame numbers and on when each frame starts. Without beacons (or as master),
+  /// the clock runs on local time.
+  class ClusterClock : public P44Obj
+  {
+  public:
+
+    typedef boost::function<void ()> ChangeCB;
+
+  private:
+
+    static const int offsetWindow = 16; ///< number of beacons the offset estimate is taken from
+
+    bool mMaster;
+    string mGroup;
+    int mPort;
+    string mInterface;
+    int mFd;
+    MLTicket mBeaconTicket;
+    uint32_t mSeq;
+
+    MLMicroSeconds mFrameInterval;
+    MLMicroSeconds mEpoch; ///< start of frame 0, in master time
+    MLMicroSeconds mOffset; ///< master time minus local time
+    MLMicroSeconds mSamples[offsetWindow];
+    int mNumSamples;
+    int mNextSample;
+    MLMicroSeconds mLastBeacon; ///< local time of last beacon received, Never if none
+    long mBeacons;
+    long mRejected; ///< beacons with implausible epoch or frame interval
+    ChangeCB mChangeCB;
+
+  public:
+
+    /// @param aMaster if set, this node sends the beacons
+    /// @param aGroup multicast group address
+    /// @param aPort UDP port
+    /// @param aFrameInterval duration of one frame
+    /// @param aInterface IPv4 address of the interface to use for multicast, empty for default
+    ///   (use 127.0.0.1 for testing several instances on one host)
+    ClusterClock(bool aMaster, const string aGroup, int aPort, MLMicroSeconds aFrameInterval, const string aInterface = "");
+    virtual ~ClusterClock();
+
+    /// start sending or receiving beacons
+    ErrorPtr start();
+
+    /// stop
+    void stop();
+
+    /// @return true if the clock is in sync with the master (or is the master)
+    bool synchronized();
+
+    /// @param aLocalTime local mainloop time
+    /// @return number of the frame running at aLocalTime
+    int64_t frameAt(MLMicroSeconds aLocalTime);
+
+    /// @param aFrame frame number
+    /// @return cluster time when the frame starts
+    MLMicroSeconds clusterTimeOfFrame(int64_t aFrame) { return mEpoch+aFrame*mFrameInterval; }
+
+    /// @param aFrame frame number
+    /// @return local mainloop time when the frame starts
+    MLMicroSeconds localTimeOfFrame(int64_t aFrame) { return localTime(clusterTimeOfFrame(aFrame)); }
+
+    /// @param aLocalTime local mainloop time
+    /// @return the same point in time in the master's mainloop time (cluster time)
+    MLMicroSeconds clusterTime(MLMicroSeconds aLocalTime) { return aLocalTime+mOffset; }
+
+    /// @param aClusterTime time in the master's mainloop time
+    /// @return the same point in time in local mainloop time
+    MLMicroSeconds localTime(MLMicroSeconds aClusterTime) { return aClusterTime-mOffset; }
+
+    /// @return local time of the start of the next frame after aLocalTime
+    MLMicroSeconds nextFrameStart(MLMicroSeconds aLocalTime) { return localTimeOfFrame(frameAt(aLocalTime)+1); }
+
+    /// @param aChangeCB called whenever the mapping between cluster and local time changes,
+    ///   so times converted to local time before must be converted again
+    void setChangeHandler(ChangeCB aChangeCB) { mChangeCB = aChangeCB; }
+
+    /// process a received beacon
+    /// @param aData the beacon as received
+    /// @param aSize size of the beacon
+    /// @param aReceivedAt local mainloop time the beacon was received
+    /// @return false if the beacon was rejected as invalid
+    bool processBeacon(const void *aData, size_t aSize, MLMicroSeconds aReceivedAt);
+
+    /// @return a beacon as sent by a master
+    /// @param aSeq sequence number
+    /// @param aMasterTime the master's mainloop time at sending
+    /// @param aEpoch start of frame 0 in master time
+    /// @param aFrameInterval duration of one frame
+    static string beacon(uint32_t aSeq, MLMicroSeconds aMasterTime, MLMicroSeconds aEpoch, MLMicroSeconds aFrameInterval);
+
+    /// @return status and statistics
+    JsonObjectPtr stats();
+
+  private:
+
+    void sendBeacon();
+    bool beaconReceived(int aFD, int aPollFlags);
+
+  };
+
+} // namespace p44
+
+#endif /* defined(__p44featured__clusterclock__) */
@@ -0,0 +1,156 @@
+//
+//  Copyright (c) 2026 plan44.ch / Lukas Zeller, Zurich, Switzerland
+//
+//  Author: Lukas Zeller <luz@plan44.ch>
+//
+//  This file is part of p44featured.
+//
+//  p44featured is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  p44featured is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with p44featured. If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "commandscheduler.hpp"
+
+using namespace p44;
+
+#define MAX_SCHEDULED_COMMANDS 1000
+#define LATE_TOLERANCE (2*MilliSecond) // execution later than this counts as late
+
+
+CommandScheduler::CommandScheduler(ExecuteCB aExecuteCB, ClusterClockPtr aFrameClock) :
+  mExecuteCB(aExecuteCB),
+  mFrameClock(aFrameClock),
+  mTimerAt(Never),
+  mSeq(0),
+  mScheduled(0),
+  mExecuted(0),
+  mLate(0),
+  mTotalLateness(0),
+  mMaxLateness(0)
+{
+  if (mFrameClock) mFrameClock->setChangeHandler(boost::bind(&CommandScheduler::clockChanged, this));
+}
+
+
+CommandScheduler::~CommandScheduler()
+{
+  if (mFrameClock) mFrameClock->setChangeHandler(ClusterClock::ChangeCB());
+  mTimer.cancel();
+}
+
+
+ErrorPtr CommandScheduler::schedule(JsonObjectPtr aRequest, RequestDoneCB aRequestDoneCB, MLMicroSeconds aWhen, bool aAlign)
+{
+  if (mQueue.size()>=MAX_SCHEDULED_COMMANDS) {
+    return WebError::webErr(503, "too many scheduled commands");
+  }
+  if (aAlign && mFrameClock) {
+    int64_t f = mFrameClock->frameAt(localTime(aWhen));
+    MLMicroSeconds start = mFrameClock->clusterTimeOfFrame(f);
+    aWhen = start<aWhen ? mFrameClock->clusterTimeOfFrame(f+1) : start;
+  }
+  mScheduled++;
+  Entry e;
+  e.when = aWhen;
+  e.seq = ++mSeq;
+  e.request = aRequest;
+  e.doneCB = aRequestDoneCB;
+  MLMicroSeconds now = clockTime();
+  if (aWhen<=now && mQueue.empty()) {
+    // due already, nothing to wait for
+    execute(e, now);
+    return ErrorPtr();
+  }
+  mQueue.push(e);
+  armTimer();
+  return ErrorPtr();
+}
+
+
+void CommandScheduler::execute(Entry &aEntry, MLMicroSeconds aNow)
+{
+  MLMicroSeconds lateness = aNow-aEntry.when;
+  if (lateness<0) lateness = 0;
+  mExecuted++;
+  mTotalLateness += lateness;
+  if (lateness>mMaxLateness) mMaxLateness = lateness;
+  if (lateness>LATE_TOLERANCE) {
+    mLate++;
+    LOG(LOG_INFO, "scheduled command executed %lld uS late", (long long)lateness);
+  }
+  mExecuteCB(aEntry.request, aEntry.doneCB);
+}
+
+
+void CommandScheduler::armTimer()
+{
+  if (mQueue.empty()) {
+    mTimer.cancel();
+    mTimerAt = Never;
+    return;
+  }
+  MLMicroSeconds next = mQueue.top().when;
+  if (next==mTimerAt) return; // already armed for the earliest entry
+  mTimerAt = next;
+  // converted now, with the current offset, see clockChanged()
+  mTimer.executeOnceAt(boost::bind(&CommandScheduler::runDue, this), localTime(next));
+}
+
+
+void CommandScheduler::runDue()
+{
+  mTimerAt = Never;
+  // all requests of this frame execute in the same mainloop cycle
+  MLMicroSeconds now = clockTime();
+  while (!mQueue.empty() && mQueue.top().when<=now) {
+    Entry e = mQueue.top();
+    mQueue.pop();
+    execute(e, now);
+  }
+  armTimer();
+}
+
+
+void CommandScheduler::clockChanged()
+{
+  // local time of the next entry has changed
+  mTimerAt = Never;
+  armTimer();
+}
+
+
+void CommandScheduler::stop()
+{
+  mTimer.cancel();
+  mTimerAt = Never;
+  while (!mQueue.empty()) {
+    Entry e = mQueue.top();
+    mQueue.pop();
+    if (e.doneCB) e.doneCB(JsonObjectPtr(), WebError::webErr(503, "scheduled command discarded"));
+  }
+}
+
+
+JsonObjectPtr CommandScheduler::stats()
+{
+  JsonObjectPtr s = JsonObject::newObj();
+  s->add("clocktime", JsonObject::newDouble((double)clockTime()/Second));
+  s->add("aligned", JsonObject::newBool(mFrameClock!=NULL));
+  s->add("pending", JsonObject::newInt64(mQueue.size()));
+  s->add("scheduled", JsonObject::newInt64(mScheduled));
+  s->add("executed", JsonObject::newInt64(mExecuted));
+  s->add("late", JsonObject::newInt64(mLate));
+  s->add("avglateness_us", JsonObject::newInt64(mExecuted>0 ? mTotalLateness/mExecuted : 0));
+  s->add("maxlateness_us", JsonObject::newInt64(mMaxLateness));
+  return s;
+}
@@ -0,0 +1,121 @@
+//
+//  Copyright (c) 2026 plan44.ch / Lukas Zeller, Zurich, Switzerland
+//
+//  Author: Lukas Zeller <luz@plan44.ch>
+//
+//  This file is part of p44featured.
+//
+//  p44featured is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  p44featured is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with p44featured. If not, see <http://www.gnu.org/licenses/>.
+//
+
+#ifndef __p44featured__commandscheduler__
+#define __p44featured__commandscheduler__
+
+#include "p44utils_common.hpp"
+#include "featureapi.hpp"
+#include "clusterclock.hpp"
+
+#include <queue>
+
+using namespace std;
+
+namespace p44 {
+
+  class CommandScheduler;
+  typedef boost::intrusive_ptr<CommandScheduler> CommandSchedulerPtr;
+
+  /// Holds feature API requests until their execution time, in a priority queue served by a single timer.
+  /// Execution times can be aligned to the start of the next frame of a frame clock, so commands
+  /// sent ahead of time take effect on a frame boundary regardless of network jitter.
+  /// Execution times are kept in frame clock time (cluster time in a cluster) and only converted to
+  /// local time when arming the timer, so changes of the cluster offset apply to queued requests, too.
+  class CommandScheduler : public P44Obj
+  {
+  public:
+
+    typedef boost::function<void (JsonObjectPtr aRequest, RequestDoneCB aRequestDoneCB)> ExecuteCB;
+
+  private:
+
+    struct Entry {
+      MLMicroSeconds when; ///< frame clock time
+      uint64_t seq; ///< keeps requests for the same time in arrival order
+      JsonObjectPtr request;
+      RequestDoneCB doneCB;
+      bool operator>(const Entry &aOther) const { return when>aOther.when || (when==aOther.when && seq>aOther.seq); }
+    };
+    typedef std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry> > EntryQueue;
+
+    ExecuteCB mExecuteCB;
+    ClusterClockPtr mFrameClock;
+    EntryQueue mQueue;
+    MLTicket mTimer;
+    MLMicroSeconds mTimerAt; ///< frame clock time the timer is armed for, Never if not armed
+    uint64_t mSeq;
+
+    long mScheduled;
+    long mExecuted;
+    long mLate; ///< executed later than the tolerance, including requests that arrived too late
+    MLMicroSeconds mTotalLateness;
+    MLMicroSeconds mMaxLateness;
+
+  public:
+
+    /// @param aExecuteCB called to execute a request when it is due
+    /// @param aFrameClock clock to align execution times to, NULL for no alignment (frame clock time is
+    ///   local mainloop time then). The scheduler installs itself as the clock's change handler.
+    CommandScheduler(ExecuteCB aExecuteCB, ClusterClockPtr aFrameClock);
+    virtual ~CommandScheduler();
+
+    /// schedule a request
+    /// @param aRequest the request
+    /// @param aRequestDoneCB passed to the execute callback
+    /// @param aWhen frame clock time of execution
+    /// @param aAlign if set, execution is delayed to the start of the next frame (if not already on a frame start)
+    /// @return error if the queue is full
+    /// @note requests that are due already are executed right away
+    ErrorPtr schedule(JsonObjectPtr aRequest, RequestDoneCB aRequestDoneCB, MLMicroSeconds aWhen, bool aAlign);
+
+    /// @param aClockTime time on the frame clock (cluster time in a cluster)
+    /// @return local mainloop time
+    MLMicroSeconds localTime(MLMicroSeconds aClockTime) { return mFrameClock ? mFrameClock->localTime(aClockTime) : aClockTime; }
+
+    /// @param aLocalTime local mainloop time
+    /// @return time on the frame clock
+    MLMicroSeconds clockTime(MLMicroSeconds aLocalTime) { return mFrameClock ? mFrameClock->clusterTime(aLocalTime) : aLocalTime; }
+
+    /// @return current time on the frame clock
+    MLMicroSeconds clockTime() { return clockTime(MainLoop::now()); }
+
+    /// @return number of requests waiting
+    size_t pending() const { return mQueue.size(); }
+
+    /// discard all pending requests, reporting an error to their callbacks
+    void stop();
+
+    /// @return statistics
+    JsonObjectPtr stats();
+
+  private:
+
+    void execute(Entry &aEntry, MLMicroSeconds aNow);
+    void armTimer();
+    void runDue();
+    void clockChanged();
+
+  };
+
+} // namespace p44
+
+#endif /* defined(__p44featured__commandscheduler__) */
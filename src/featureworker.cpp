@@ -0,0 +1,271 @@
+//
+//  Copyright (c) 2026 plan44.ch / Lukas Zeller, Zurich, Switzerland
+//
+//  Author: Lukas Zeller <luz@plan44.ch>
+//
+//  This file is part of p44featured.
+//
+//  p44featured is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  p44featured is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with p44featured. If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "featureworker.hpp"
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+
+using namespace p44;
+
+
+/// error from a worker thread, rebuilt on the main thread with its original domain and code
+class ForwardedError : public Error
+{
+  string mDomain;
+
+public:
+
+  ForwardedError(const string aDomain, ErrorCode aErrorCode, const string aErrorMessage) :
+    Error(aErrorCode, aErrorMessage),
+    mDomain(aDomain)
+  {};
+
+  virtual const char *getErrorDomain() const P44_OVERRIDE { return mDomain.c_str(); };
+};
+
+
+FeatureWorker::FeatureWorker(const string aName, FeatureFactoryCB aFactory, CreatedCB aCreatedCB) :
+  mName(aName),
+  mFactory(aFactory),
+  mCreatedCB(aCreatedCB),
+  mRunning(false),
+  mMaxQueued(0),
+  mCount(0),
+  mTotalLatency(0),
+  mMaxLatency(0)
+{
+  pthread_mutex_init(&mMutex, NULL);
+  mRequestPipe[0] = mRequestPipe[1] = -1;
+  mResponsePipe[0] = mResponsePipe[1] = -1;
+}
+
+
+FeatureWorker::~FeatureWorker()
+{
+  stop();
+  pthread_mutex_destroy(&mMutex);
+}
+
+
+ErrorPtr FeatureWorker::start()
+{
+  if (mRunning) return ErrorPtr();
+  if (pipe(mRequestPipe)<0) return SysError::errNo("feature worker request pipe: ");
+  if (pipe(mResponsePipe)<0) {
+    ErrorPtr err = SysError::errNo("feature worker response pipe: ");
+    close(mRequestPipe[0]); close(mRequestPipe[1]);
+    return err;
+  }
+  for (int i=0; i<2; i++) {
+    fcntl(mRequestPipe[i], F_SETFL, fcntl(mRequestPipe[i], F_GETFL) | O_NONBLOCK);
+    fcntl(mResponsePipe[i], F_SETFL, fcntl(mResponsePipe[i], F_GETFL) | O_NONBLOCK);
+  }
+  MainLoop::currentMainLoop().registerPollHandler(mResponsePipe[0], POLLIN, boost::bind(&FeatureWorker::responsesReady, this, _1, _2));
+  if (pthread_create(&mThread, NULL, &FeatureWorker::workerThread, this)!=0) {
+    ErrorPtr err = SysError::errNo("cannot start feature worker thread: ");
+    MainLoop::currentMainLoop().unregisterPollHandler(mResponsePipe[0]);
+    for (int i=0; i<2; i++) { close(mRequestPipe[i]); close(mResponsePipe[i]); }
+    return err;
+  }
+  mRunning = true;
+  LOG(LOG_NOTICE, "feature '%s' runs on its own thread", mName.c_str());
+  return ErrorPtr();
+}
+
+
+void FeatureWorker::stop()
+{
+  if (!mRunning) return;
+  Message m;
+  m.id = stopId;
+  m.errorCode = 0;
+  post(mRequests, mRequestPipe[1], m);
+  pthread_join(mThread, NULL);
+  mRunning = false;
+  MainLoop::currentMainLoop().unregisterPollHandler(mResponsePipe[0]);
+  for (int i=0; i<2; i++) {
+    close(mRequestPipe[i]);
+    close(mResponsePipe[i]);
+  }
+}
+
+
+void FeatureWorker::post(MessageQueue &aQueue, int aWakeFd, const Message &aMessage)
+{
+  pthread_mutex_lock(&mMutex);
+  bool wasEmpty = aQueue.empty();
+  aQueue.push_back(aMessage);
+  pthread_mutex_unlock(&mMutex);
+  if (wasEmpty) {
+    // one wakeup per batch is enough, receiver takes all queued messages
+    char c = 0;
+    if (write(aWakeFd, &c, 1)<0) { /* pipe full means receiver has a wakeup pending anyway */ }
+  }
+}
+
+
+void FeatureWorker::fetch(MessageQueue &aQueue, int aWakeFd, MessageQueue &aMessages)
+{
+  char buf[64];
+  while (read(aWakeFd, buf, sizeof(buf))>0);
+  pthread_mutex_lock(&mMutex);
+  aMessages.swap(aQueue);
+  pthread_mutex_unlock(&mMutex);
+}
+
+
+// MARK: - worker thread
+
+void *FeatureWorker::workerThread(void *aArg)
+{
+  FeatureWorker *w = static_cast<FeatureWorker *>(aArg);
+  // the feature registers its timers and I/O handlers with this thread's own mainloop
+  MainLoop &ml = MainLoop::currentMainLoop();
+  MLMicroSeconds start = MainLoop::now();
+  w->mFeature = w->mFactory();
+  Message m;
+  m.id = createdId;
+  m.errorCode = 0;
+  m.creationTime = MainLoop::now()-start;
+  // release the factory and the objects bound into it here, the worker thread owns them
+  w->mFactory = FeatureFactoryCB();
+  LOG(LOG_INFO, "feature '%s' created on worker thread in %lld uS", w->mName.c_str(), (long long)m.creationTime);
+  w->post(w->mResponses, w->mResponsePipe[1], m);
+  ml.registerPollHandler(w->mRequestPipe[0], POLLIN, boost::bind(&FeatureWorker::requestsReady, w, _1, _2));
+  ml.run();
+  return NULL;
+}
+
+
+bool FeatureWorker::requestsReady(int aFD, int aPollFlags)
+{
+  MessageQueue requests;
+  fetch(mRequests, mRequestPipe[0], requests);
+  while (!requests.empty()) {
+    Message &m = requests.front();
+    if (m.id==stopId) {
+      // stop: feature must be deleted on the thread it lives on
+      mFeature.reset();
+      MainLoop::currentMainLoop().unregisterPollHandler(mRequestPipe[0]);
+      MainLoop::currentMainLoop().terminate(EXIT_SUCCESS);
+      return true;
+    }
+    ErrorPtr err;
+    JsonObjectPtr request = JsonObject::objFromText(m.json.c_str(), m.json.size(), &err);
+    ApiRequestPtr req = ApiRequestPtr(new APICallbackRequest(request, boost::bind(&FeatureWorker::workerResponse, this, m.id, _1, _2)));
+    if (Error::isOK(err) && mFeature) {
+      err = mFeature->processRequest(req);
+    }
+    else if (!mFeature) {
+      err = TextError::err("feature '%s' could not be created", mName.c_str());
+    }
+    if (err) {
+      // answered synchronously
+      req->sendResponse(JsonObjectPtr(), err);
+    }
+    requests.pop_front();
+  }
+  return true;
+}
+
+
+void FeatureWorker::workerResponse(int aId, JsonObjectPtr aResponse, ErrorPtr aError)
+{
+  Message m;
+  m.id = aId;
+  m.errorCode = 0;
+  if (aResponse) m.json = aResponse->json_str();
+  if (Error::notOK(aError)) {
+    m.errorDomain = aError->getErrorDomain();
+    m.errorCode = aError->getErrorCode();
+    m.errorText = aError->text();
+  }
+  post(mResponses, mResponsePipe[1], m);
+}
+
+
+// MARK: - main thread
+
+void FeatureWorker::handleRequest(JsonObjectPtr aRequest, RequestDoneCB aRequestDoneCB)
+{
+  PendingRequest p;
+  p.valid = true;
+  p.doneCB = aRequestDoneCB;
+  p.queuedAt = MainLoop::now();
+  Message m;
+  m.id = mPending.put(p);
+  if (m.id<0) {
+    if (aRequestDoneCB) aRequestDoneCB(JsonObjectPtr(), TextError::err("feature '%s': too many pending requests", mName.c_str()));
+    return;
+  }
+  m.errorCode = 0;
+  m.json = aRequest ? aRequest->json_str() : "{}";
+  if (mPending.pending()>mMaxQueued) mMaxQueued = mPending.pending();
+  post(mRequests, mRequestPipe[1], m);
+}
+
+
+bool FeatureWorker::responsesReady(int aFD, int aPollFlags)
+{
+  MessageQueue responses;
+  fetch(mResponses, mResponsePipe[0], responses);
+  MLMicroSeconds now = MainLoop::now();
+  while (!responses.empty()) {
+    Message &m = responses.front();
+    if (m.id==createdId) {
+      if (mCreatedCB) mCreatedCB(m.creationTime);
+      mCreatedCB = CreatedCB(); // once
+      responses.pop_front();
+      continue;
+    }
+    PendingRequest p = mPending.take(m.id);
+    if (!p.valid) {
+      LOG(LOG_ERR, "feature '%s': response without pending request", mName.c_str());
+      responses.pop_front();
+      continue;
+    }
+    MLMicroSeconds latency = now-p.queuedAt;
+    mCount++;
+    mTotalLatency += latency;
+    if (latency>mMaxLatency) mMaxLatency = latency;
+    JsonObjectPtr response;
+    if (!m.json.empty()) response = JsonObject::objFromText(m.json.c_str(), m.json.size());
+    ErrorPtr err;
+    if (!m.errorDomain.empty()) err = ErrorPtr(new ForwardedError(m.errorDomain, m.errorCode, m.errorText));
+    if (p.doneCB) p.doneCB(response, err);
+    responses.pop_front();
+  }
+  return true;
+}
+
+
+JsonObjectPtr FeatureWorker::stats()
+{
+  JsonObjectPtr s = JsonObject::newObj();
+  s->add("queued", JsonObject::newInt64(mPending.pending()));
+  s->add("maxqueued", JsonObject::newInt64(mMaxQueued));
+  s->add("requests", JsonObject::newInt64(mCount));
+  s->add("avg_latency_us", JsonObject::newInt64(mCount>0 ? mTotalLatency/mCount : 0));
+  s->add("max_latency_us", JsonObject::newInt64(mMaxLatency));
+  return s;
+}
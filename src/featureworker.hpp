@@ -0,0 +1,142 @@
+//
+//  Copyright (c) 2026 plan44.ch / Lukas Zeller, Zurich, Switzerland
+//
+//  Author: Lukas Zeller <luz@plan44.ch>
+//
+//  This file is part of p44featured.
+//
+//  p44featured is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  p44featured is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with p44featured. If not, see <http://www.gnu.org/licenses/>.
+//
+
+#ifndef __p44featured__featureworker__
+#define __p44featured__featureworker__
+
+#include "p44utils_common.hpp"
+#include "featureapi.hpp"
+#include "inlinecb.hpp"
+
+#include <pthread.h>
+#include <deque>
+
+using namespace std;
+
+namespace p44 {
+
+  class FeatureWorker;
+  typedef boost::intrusive_ptr<FeatureWorker> FeatureWorkerPtr;
+
+  /// Runs a feature on its own thread with its own mainloop, so slow I/O in the feature
+  /// cannot delay requests to other features.
+  /// Requests are passed to the worker through a queue, responses come back through another queue
+  /// and are delivered on the calling (main) thread. Messages cross the thread boundary as JSON text,
+  /// as JsonObject reference counting is not thread safe. Errors keep their domain and code.
+  /// Only self-contained features can be isolated: they must not use other features, views or script
+  /// globals, and must not send event messages, as FeatureApi may only be used from the main thread.
+  class FeatureWorker : public P44Obj
+  {
+  public:
+
+    typedef boost::function<FeaturePtr ()> FeatureFactoryCB;
+    typedef boost::function<void (MLMicroSeconds aCreationTime)> CreatedCB;
+
+  private:
+
+    enum {
+      stopId = -1, ///< request: stop the worker
+      createdId = -2 ///< response: the feature was created (or failed to be created)
+    };
+
+    struct Message {
+      int id; ///< slot of the pending request, or stopId/createdId
+      string json;
+      string errorDomain; ///< error domain for responses, empty if no error
+      ErrorCode errorCode;
+      string errorText;
+      MLMicroSeconds creationTime; ///< for createdId: time the factory took
+    };
+    typedef std::deque<Message> MessageQueue;
+
+    struct PendingRequest {
+      bool valid; ///< false in the empty context returned for invalid ids
+      RequestDoneCB doneCB;
+      MLMicroSeconds queuedAt;
+    };
+
+    string mName;
+    FeatureFactoryCB mFactory; ///< owned by the worker thread once started
+    CreatedCB mCreatedCB;
+    pthread_t mThread;
+    bool mRunning;
+    pthread_mutex_t mMutex;
+    MessageQueue mRequests; ///< main -> worker, protected by mMutex
+    MessageQueue mResponses; ///< worker -> main, protected by mMutex
+    int mRequestPipe[2]; ///< wakes the worker
+    int mResponsePipe[2]; ///< wakes the main thread
+
+    // worker thread only
+    FeaturePtr mFeature;
+
+    // main thread only
+    CallbackSlots<PendingRequest> mPending;
+    size_t mMaxQueued;
+    long mCount;
+    MLMicroSeconds mTotalLatency;
+    MLMicroSeconds mMaxLatency;
+
+  public:
+
+    /// @param aName name of the feature
+    /// @param aFactory creates the feature, called on the worker thread. All resources (pins, bus
+    ///   devices) must already be set up and bound into the factory, which must only construct the feature.
+    ///   The worker takes over the factory and everything bound into it: the caller must not keep any copy
+    ///   of the factory or the bound objects when calling start(), as their reference counts are not thread safe.
+    /// @param aCreatedCB called on the main thread with the time it took to create the feature on the worker thread
+    FeatureWorker(const string aName, FeatureFactoryCB aFactory, CreatedCB aCreatedCB);
+    virtual ~FeatureWorker();
+
+    /// start the worker thread, which creates the feature and runs its mainloop
+    ErrorPtr start();
+
+    /// stop the worker thread, deletes the feature on the worker thread
+    void stop();
+
+    /// queue a request for the feature
+    /// @param aRequest the feature API request
+    /// @param aRequestDoneCB called on the calling thread's mainloop with the response
+    void handleRequest(JsonObjectPtr aRequest, RequestDoneCB aRequestDoneCB);
+
+    /// @return queue depth and latency statistics
+    JsonObjectPtr stats();
+
+    /// @return name of the feature
+    const string &name() const { return mName; }
+
+  private:
+
+    static void *workerThread(void *aArg);
+    void post(MessageQueue &aQueue, int aWakeFd, const Message &aMessage);
+    void fetch(MessageQueue &aQueue, int aWakeFd, MessageQueue &aMessages);
+
+    // worker thread
+    bool requestsReady(int aFD, int aPollFlags);
+    void workerResponse(int aId, JsonObjectPtr aResponse, ErrorPtr aError);
+
+    // main thread
+    bool responsesReady(int aFD, int aPollFlags);
+
+  };
+
+} // namespace p44
+
+#endif /* defined(__p44featured__featureworker__) */
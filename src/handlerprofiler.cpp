@@ -0,0 +1,174 @@
+//
+//  Copyright (c) 2026 plan44.ch / Lukas Zeller, Zurich, Switzerland
+//
+//  Author: Lukas Zeller <luz@plan44.ch>
+//
+//  This file is part of p44featured.
+//
+//  p44featured is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  p44featured is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with p44featured. If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "handlerprofiler.hpp"
+
+using namespace p44;
+
+#define PROBE_CATEGORY "mainloop.lag"
+
+
+HandlerProfiler::HandlerProfiler() :
+  mEnabled(false),
+  mBudget(20*MilliSecond),
+  mStartedAt(Never),
+  mStallSeq(0),
+  mProbeInterval(0),
+  mProbeDue(Never)
+{
+}
+
+
+HandlerProfiler &HandlerProfiler::sharedProfiler()
+{
+  static HandlerProfiler profiler;
+  return profiler;
+}
+
+
+void HandlerProfiler::enable(MLMicroSeconds aBudget, MLMicroSeconds aProbeInterval)
+{
+  mEnabled = true;
+  mBudget = aBudget;
+  mStartedAt = MainLoop::now();
+  mProbeInterval = aProbeInterval;
+  if (mProbeInterval>0) {
+    mProbeDue = MainLoop::now()+mProbeInterval;
+    mProbeTicket.executeOnceAt(boost::bind(&HandlerProfiler::probe, this), mProbeDue);
+  }
+  LOG(LOG_NOTICE, "handler profiling enabled, stall budget = %lld uS", (long long)mBudget);
+}
+
+
+void HandlerProfiler::probe()
+{
+  MLMicroSeconds now = MainLoop::now();
+  // how late did the mainloop run us?
+  record(PROBE_CATEGORY, now-mProbeDue);
+  mProbeDue = now+mProbeInterval;
+  mProbeTicket.executeOnceAt(boost::bind(&HandlerProfiler::probe, this), mProbeDue);
+}
+
+
+void HandlerProfiler::leaveScope(const string &aCategory, MLMicroSeconds aElapsed)
+{
+  if (mNestedTimes.empty()) return; // reset() while scope was open
+  MLMicroSeconds nested = mNestedTimes.back();
+  mNestedTimes.pop_back();
+  bool outermost = mNestedTimes.empty();
+  if (!outermost) mNestedTimes.back() += aElapsed;
+  record(aCategory, aElapsed-nested, false);
+  if (outermost && aElapsed>mBudget) {
+    // stalls are judged on the total time of the outermost handler, and reported once
+    mStats[mStats.count(aCategory) ? aCategory : "other"].stalls++;
+    mStallSeq++;
+    LOG(LOG_WARNING, "STALL#%ld: '%s' took %lld uS (%lld uS in nested handlers, budget %lld uS)", mStallSeq, aCategory.c_str(), (long long)aElapsed, (long long)nested, (long long)mBudget);
+  }
+}
+
+
+void HandlerProfiler::record(const string &aCategory, MLMicroSeconds aDuration, bool aCheckStall)
+{
+  if (!mEnabled) return;
+  if (aDuration<0) aDuration = 0;
+  StatsMap::iterator pos = mStats.find(aCategory);
+  if (pos==mStats.end() && mStats.size()>=maxCategories) {
+    pos = mStats.find("other");
+  }
+  if (pos==mStats.end()) {
+    Stats s;
+    memset(&s, 0, sizeof(s));
+    pos = mStats.insert(make_pair(mStats.size()<maxCategories ? aCategory : string("other"), s)).first;
+  }
+  Stats &s = pos->second;
+  s.count++;
+  s.total += aDuration;
+  if (aDuration>s.max) s.max = aDuration;
+  int b = 0;
+  MLMicroSeconds lim = 16;
+  while (b<numBuckets-1 && aDuration>=lim) { b++; lim <<= 1; }
+  s.buckets[b]++;
+  if (aCheckStall && aDuration>mBudget) {
+    s.stalls++;
+    mStallSeq++;
+    LOG(LOG_WARNING, "STALL#%ld: '%s' took %lld uS (budget %lld uS)", mStallSeq, aCategory.c_str(), (long long)aDuration, (long long)mBudget);
+  }
+}
+
+
+JsonObjectPtr HandlerProfiler::metrics()
+{
+  JsonObjectPtr m = JsonObject::newObj();
+  m->add("enabled", JsonObject::newBool(mEnabled));
+  if (!mEnabled) return m;
+  m->add("budget_us", JsonObject::newInt64(mBudget));
+  m->add("period_us", JsonObject::newInt64(MainLoop::now()-mStartedAt));
+  m->add("stalls", JsonObject::newInt64(mStallSeq));
+  JsonObjectPtr handlers = JsonObject::newObj();
+  for (StatsMap::iterator pos = mStats.begin(); pos!=mStats.end(); ++pos) {
+    Stats &s = pos->second;
+    JsonObjectPtr h = JsonObject::newObj();
+    h->add("count", JsonObject::newInt64(s.count));
+    h->add("total_us", JsonObject::newInt64(s.total));
+    h->add("avg_us", JsonObject::newInt64(s.count>0 ? s.total/s.count : 0));
+    h->add("max_us", JsonObject::newInt64(s.max));
+    h->add("stalls", JsonObject::newInt64(s.stalls));
+    // histogram, keyed by upper bucket limit in uS, only non-empty buckets
+    JsonObjectPtr hist = JsonObject::newObj();
+    MLMicroSeconds lim = 16;
+    for (int b=0; b<numBuckets; b++, lim <<= 1) {
+      if (s.buckets[b]>0) {
+        hist->add(b<numBuckets-1 ? string_format("<%lld", (long long)lim).c_str() : "more", JsonObject::newInt64(s.buckets[b]));
+      }
+    }
+    h->add("histogram", hist);
+    handlers->add(pos->first.c_str(), h);
+  }
+  m->add("handlers", handlers);
+  return m;
+}
+
+
+void HandlerProfiler::reset()
+{
+  mStats.clear();
+  mNestedTimes.clear();
+  mStallSeq = 0;
+  mStartedAt = MainLoop::now();
+}
+
+
+string HandlerProfiler::summary()
+{
+  string s = string_format(
+    "Handler profile over %.1f seconds, budget %lld uS, %ld stalls\n"
+    "%-32s %10s %10s %10s %10s\n",
+    (double)(MainLoop::now()-mStartedAt)/Second, (long long)mBudget, mStallSeq,
+    "handler", "count", "avg uS", "max uS", "stalls"
+  );
+  for (StatsMap::iterator pos = mStats.begin(); pos!=mStats.end(); ++pos) {
+    Stats &st = pos->second;
+    string_format_append(s, "%-32s %10ld %10lld %10lld %10ld\n",
+      pos->first.c_str(), st.count, (long long)(st.count>0 ? st.total/st.count : 0), (long long)st.max, st.stalls
+    );
+  }
+  return s;
+}
@@ -0,0 +1,147 @@
+//
+//  Copyright (c) 2026 plan44.ch / Lukas Zeller, Zurich, Switzerland
+//
+//  Author: Lukas Zeller <luz@plan44.ch>
+//
+//  This file is part of p44featured.
+//
+//  p44featured is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  p44featured is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with p44featured. If not, see <http://www.gnu.org/licenses/>.
+//
+
+#ifndef __p44featured__handlerprofiler__
+#define __p44featured__handlerprofiler__
+
+#include "p44utils_common.hpp"
+#include "jsonobject.hpp"
+
+using namespace std;
+
+namespace p44 {
+
+  /// Collects execution times of mainloop handlers, grouped by category (e.g. "api.featureapi", "featureapi.light").
+  /// Nested timing scopes record their self time (excluding nested scopes), so totals are not counted twice.
+  /// Outermost scopes exceeding the budget are counted and logged as stalls, once per stall.
+  /// Categories can contain client supplied names, so their number is capped, further ones are counted as "other".
+  /// In addition, a periodic probe measures how late the mainloop runs timers, which catches stalls
+  /// caused by handlers that are not instrumented (animations, LED output, script timers).
+  class HandlerProfiler
+  {
+    static const int numBuckets = 16; ///< log2 histogram: bucket n counts durations < 2^(n+4) uS, last bucket is open ended
+    static const size_t maxCategories = 64; ///< beyond this, new categories are recorded as "other"
+
+    struct Stats {
+      long count;
+      MLMicroSeconds total;
+      MLMicroSeconds max;
+      long stalls;
+      long buckets[numBuckets];
+    };
+    typedef map<string, Stats> StatsMap;
+
+    StatsMap mStats;
+    bool mEnabled;
+    MLMicroSeconds mBudget;
+    MLMicroSeconds mStartedAt;
+    long mStallSeq; ///< sequence number for identifying stalls in the log
+    MLTicket mProbeTicket;
+    MLMicroSeconds mProbeInterval;
+    MLMicroSeconds mProbeDue;
+    std::vector<MLMicroSeconds> mNestedTimes; ///< per open scope, time spent in scopes nested in it
+
+    HandlerProfiler();
+
+  public:
+
+    /// @return the shared instance
+    static HandlerProfiler &sharedProfiler();
+
+    /// enable profiling
+    /// @param aBudget execution time above which a handler is considered a stall
+    /// @param aProbeInterval interval for the mainloop lag probe, 0 to disable
+    void enable(MLMicroSeconds aBudget, MLMicroSeconds aProbeInterval);
+
+    /// @return true if profiling is enabled
+    bool isEnabled() const { return mEnabled; }
+
+    /// record the execution time of a handler
+    /// @param aCategory the handler category
+    /// @param aDuration the execution time
+    /// @param aCheckStall if set, a duration exceeding the budget is counted and logged as a stall
+    void record(const string &aCategory, MLMicroSeconds aDuration, bool aCheckStall = true);
+
+    /// begin a timing scope (see ScopedHandlerTiming)
+    void enterScope() { mNestedTimes.push_back(0); }
+
+    /// end a timing scope and record its self time
+    /// @param aCategory the handler category
+    /// @param aElapsed total time the scope was open
+    void leaveScope(const string &aCategory, MLMicroSeconds aElapsed);
+
+    /// @return statistics as JSON
+    JsonObjectPtr metrics();
+
+    /// reset statistics
+    void reset();
+
+    /// @return human readable summary
+    string summary();
+
+  private:
+
+    void probe();
+
+  };
+
+
+  /// measures the time from construction to destruction and records it in the shared profiler
+  class ScopedHandlerTiming
+  {
+    const char *mCategory;
+    string mCategoryStr;
+    MLMicroSeconds mStart;
+
+  public:
+
+    ScopedHandlerTiming(const char *aCategory) :
+      mCategory(aCategory),
+      mStart(Never)
+    {
+      if (HandlerProfiler::sharedProfiler().isEnabled()) {
+        HandlerProfiler::sharedProfiler().enterScope();
+        mStart = MainLoop::now();
+      }
+    }
+
+    ScopedHandlerTiming(const string aCategoryPrefix, const string aName) :
+      mCategory(NULL),
+      mStart(Never)
+    {
+      if (HandlerProfiler::sharedProfiler().isEnabled()) {
+        mCategoryStr = aCategoryPrefix+aName;
+        HandlerProfiler::sharedProfiler().enterScope();
+        mStart = MainLoop::now();
+      }
+    }
+
+    ~ScopedHandlerTiming()
+    {
+      if (mStart!=Never) {
+        HandlerProfiler::sharedProfiler().leaveScope(mCategory ? string(mCategory) : mCategoryStr, MainLoop::now()-mStart);
+      }
+    }
+  };
+
+} // namespace p44
+
+#endif /* defined(__p44featured__handlerprofiler__) */
@@ -0,0 +1,123 @@
+//
+//  Copyright (c) 2026 plan44.ch / Lukas Zeller, Zurich, Switzerland
+//
+//  Author: Lukas Zeller <luz@plan44.ch>
+//
+//  This file is part of p44featured.
+//
+//  p44featured is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  p44featured is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with p44featured. If not, see <http://www.gnu.org/licenses/>.
+//
+
+#ifndef __p44featured__inlinecb__
+#define __p44featured__inlinecb__
+
+#include "p44utils_common.hpp"
+
+#include <boost/type_traits.hpp>
+#include <climits>
+
+using namespace std;
+
+namespace p44 {
+
+  /// Size in bytes up to which boost::function stores a functor inline: its small object buffer holds
+  /// a bound member function pointer plus object pointer, which is 3 pointers on all supported ABIs.
+  #define INLINECB_MAX_SIZE (3*sizeof(void *))
+
+  /// Checks at compile time that a callback functor is stored by boost::function without heap allocation.
+  /// boost::function keeps functors inline when they fit its small buffer (INLINECB_MAX_SIZE) with no more
+  /// than pointer alignment, which covers boost::bind(&Class::method, this, _1...) and lambdas capturing
+  /// `this` plus one small value. Binding smart pointers or more arguments does not fit and allocates on
+  /// every callback creation.
+  /// Trivial copy/destruction is required as well, as older boost versions only store those inline.
+  /// @param aFunctor the functor (usually a lambda)
+  /// @return aFunctor, to be assigned to a boost::function
+  template<typename F> inline F inlineCB(F aFunctor)
+  {
+    static_assert(
+      sizeof(F)<=INLINECB_MAX_SIZE &&
+      boost::alignment_of<F>::value<=boost::alignment_of<void *>::value &&
+      boost::has_trivial_copy<F>::value &&
+      boost::has_trivial_destructor<F>::value,
+      "callback functor does not fit boost::function's small object buffer and would allocate"
+    );
+    return aFunctor;
+  }
+
+
+  /// Number of low order bits of a CallbackSlots handle holding the slot index,
+  /// the remaining bits (except the sign) hold the slot's generation.
+  #define CALLBACKSLOTS_INDEX_BITS 16
+
+  /// Storage for the context of pending callbacks that is too large (or not trivially copyable)
+  /// to be bound into the callback itself. The callback only carries an int handle, which encodes
+  /// the slot index and a generation tag. Slots are reused, so once the table has grown to the number
+  /// of concurrently pending callbacks, no more allocations occur.
+  /// A handle can be taken only once: a callback that fires twice, or late after its slot has been
+  /// reused, gets an empty context instead of another request's.
+  /// @note every callback must eventually take its handle, a callback that never fires keeps its
+  ///   slot occupied. pending() shows the number of occupied slots for monitoring.
+  template<typename T> class CallbackSlots
+  {
+    static const int indexMask = (1<<CALLBACKSLOTS_INDEX_BITS)-1;
+    static const int generationMask = INT_MAX>>CALLBACKSLOTS_INDEX_BITS;
+
+    vector<T> mSlots;
+    vector<int> mGenerations; ///< current generation of each slot, incremented when taken
+    vector<int> mFree;
+
+  public:
+
+    /// store context
+    /// @return handle to bind into the callback, -1 if all slots are occupied
+    int put(const T &aContext)
+    {
+      int slot;
+      if (mFree.empty()) {
+        if (mSlots.size()>(size_t)indexMask) return -1;
+        mSlots.push_back(aContext);
+        mGenerations.push_back(0);
+        slot = (int)mSlots.size()-1;
+      }
+      else {
+        slot = mFree.back();
+        mFree.pop_back();
+        mSlots[slot] = aContext;
+      }
+      return (mGenerations[slot]<<CALLBACKSLOTS_INDEX_BITS) | slot;
+    }
+
+    /// retrieve context and free the slot
+    /// @param aHandle handle as returned by put()
+    /// @return the context, or an empty (default constructed) context if the handle is invalid
+    ///   or was already taken
+    T take(int aHandle)
+    {
+      if (aHandle<0) return T();
+      int slot = aHandle & indexMask;
+      if ((size_t)slot>=mSlots.size() || mGenerations[slot]!=(aHandle>>CALLBACKSLOTS_INDEX_BITS)) return T();
+      T ctx = mSlots[slot];
+      mSlots[slot] = T(); // release references
+      mGenerations[slot] = (mGenerations[slot]+1) & generationMask; // invalidates the handle
+      mFree.push_back(slot);
+      return ctx;
+    }
+
+    /// @return number of pending contexts
+    size_t pending() const { return mSlots.size()-mFree.size(); }
+  };
+
+} // namespace p44
+
+#endif /* defined(__p44featured__inlinecb__) */
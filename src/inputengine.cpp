@@ -0,0 +1,463 @@
+//
+//  Copyright (c) 2026 plan44.ch / Lukas Zeller, Zurich, Switzerland
+//
+//  Author: Lukas Zeller <luz@plan44.ch>
+//
+//  This file is part of p44featured.
+//
+//  p44featured is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  p44featured is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with p44featured. If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "inputengine.hpp"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <poll.h>
+#include <errno.h>
+#include <sys/ioctl.h>
+
+#if defined(__linux__)
+  #include <linux/gpio.h>
+  #ifdef GPIO_V2_GET_LINE_IOCTL
+    #define INPUTENGINE_GPIO_CDEV 1
+  #endif
+#endif
+#ifndef INPUTENGINE_GPIO_CDEV
+  #define INPUTENGINE_GPIO_CDEV 0
+#endif
+
+#define GPIO_SYSFS_PATH "/sys/class/gpio"
+#define GPIO_CDEV_PATH "/dev/gpiochip"
+
+using namespace p44;
+
+
+// MARK: - Simulated backend
+
+namespace p44 {
+
+  class SimInputBackend : public InputBackend
+  {
+    typedef InputBackend inherited;
+    friend class InputEngine;
+
+    vector<int> mLineIds;
+
+    SimInputBackend(InputEngine &aEngine) : inherited(aEngine) {};
+
+    virtual ErrorPtr addLine(int aLineId, const string aLineName) P44_OVERRIDE
+    {
+      mLineIds.push_back(aLineId);
+      return ErrorPtr();
+    }
+
+    virtual ErrorPtr start() P44_OVERRIDE
+    {
+      // simulated inputs start inactive
+      MLMicroSeconds now = MainLoop::now();
+      for (vector<int>::iterator pos = mLineIds.begin(); pos!=mLineIds.end(); ++pos) {
+        mEngine.rawEdge(*pos, false, now);
+      }
+      return ErrorPtr();
+    }
+
+    virtual void stop() P44_OVERRIDE {};
+  };
+
+} // namespace p44
+
+
+// MARK: - sysfs GPIO backend (fallback)
+
+namespace p44 {
+
+  class SysfsInputBackend : public InputBackend
+  {
+    typedef InputBackend inherited;
+    friend class InputEngine;
+
+    struct SysfsLine {
+      int lineId;
+      int gpioNo;
+      int fd;
+    };
+    typedef vector<SysfsLine> SysfsLineVector;
+    SysfsLineVector mSysfsLines;
+
+    SysfsInputBackend(InputEngine &aEngine) : inherited(aEngine) {};
+
+    virtual ~SysfsInputBackend()
+    {
+      stop();
+    }
+
+    virtual ErrorPtr addLine(int aLineId, const string aLineName) P44_OVERRIDE
+    {
+      SysfsLine l;
+      l.lineId = aLineId;
+      if (sscanf(aLineName.c_str(), "%d", &l.gpioNo)!=1) {
+        return TextError::err("invalid GPIO number '%s'", aLineName.c_str());
+      }
+      l.fd = -1;
+      mSysfsLines.push_back(l);
+      return ErrorPtr();
+    }
+
+    static ErrorPtr writeAttr(const string aPath, const string aValue)
+    {
+      int fd = open(aPath.c_str(), O_WRONLY);
+      if (fd<0) return SysError::errNo(aPath.c_str());
+      ssize_t n = write(fd, aValue.c_str(), aValue.size());
+      close(fd);
+      if (n<0) return SysError::errNo(aPath.c_str());
+      return ErrorPtr();
+    }
+
+    virtual ErrorPtr start() P44_OVERRIDE
+    {
+      for (SysfsLineVector::iterator pos = mSysfsLines.begin(); pos!=mSysfsLines.end(); ++pos) {
+        string base = string_format(GPIO_SYSFS_PATH "/gpio%d", pos->gpioNo);
+        if (access(base.c_str(), F_OK)!=0) {
+          // not yet exported
+          writeAttr(GPIO_SYSFS_PATH "/export", string_format("%d", pos->gpioNo));
+        }
+        ErrorPtr err = writeAttr(base+"/direction", "in");
+        if (Error::isOK(err)) err = writeAttr(base+"/edge", "both");
+        if (Error::notOK(err)) return err;
+        pos->fd = open((base+"/value").c_str(), O_RDONLY|O_NONBLOCK);
+        if (pos->fd<0) return SysError::errNo("cannot open GPIO value: ");
+        // reading clears the pending edge and provides the initial state
+        readValue(*pos, MainLoop::now());
+        MainLoop::currentMainLoop().registerPollHandler(pos->fd, POLLPRI, boost::bind(&SysfsInputBackend::valueChanged, this, pos->lineId, _1, _2));
+      }
+      return ErrorPtr();
+    }
+
+    virtual void stop() P44_OVERRIDE
+    {
+      for (SysfsLineVector::iterator pos = mSysfsLines.begin(); pos!=mSysfsLines.end(); ++pos) {
+        if (pos->fd>=0) {
+          MainLoop::currentMainLoop().unregisterPollHandler(pos->fd);
+          close(pos->fd);
+          pos->fd = -1;
+        }
+      }
+    }
+
+    void readValue(SysfsLine &aLine, MLMicroSeconds aTimestamp)
+    {
+      char c = '0';
+      lseek(aLine.fd, 0, SEEK_SET);
+      if (read(aLine.fd, &c, 1)==1) {
+        mEngine.rawEdge(aLine.lineId, c!='0', aTimestamp);
+      }
+    }
+
+    bool valueChanged(int aLineId, int aFD, int aPollFlags)
+    {
+      MLMicroSeconds now = MainLoop::now();
+      for (SysfsLineVector::iterator pos = mSysfsLines.begin(); pos!=mSysfsLines.end(); ++pos) {
+        if (pos->lineId==aLineId) {
+          readValue(*pos, now);
+          break;
+        }
+      }
+      return true;
+    }
+
+  };
+
+} // namespace p44
+
+
+// MARK: - GPIO character device backend
+
+#if INPUTENGINE_GPIO_CDEV
+
+namespace p44 {
+
+  class CdevInputBackend : public InputBackend
+  {
+    typedef InputBackend inherited;
+    friend class InputEngine;
+
+    int mChipNo;
+    vector<uint32_t> mOffsets; ///< line offsets on the chip
+    vector<int> mLineIds; ///< engine line ids, same order as mOffsets
+    vector<int> mRequestFds; ///< one fd per batch of up to GPIO_V2_LINES_MAX lines
+
+    CdevInputBackend(InputEngine &aEngine, int aChipNo) :
+      inherited(aEngine),
+      mChipNo(aChipNo)
+    {
+    }
+
+    virtual ~CdevInputBackend()
+    {
+      stop();
+    }
+
+    virtual ErrorPtr addLine(int aLineId, const string aLineName) P44_OVERRIDE
+    {
+      int offset;
+      if (sscanf(aLineName.c_str(), "%d", &offset)!=1 || offset<0) {
+        return TextError::err("invalid GPIO line offset '%s'", aLineName.c_str());
+      }
+      mOffsets.push_back(offset);
+      mLineIds.push_back(aLineId);
+      return ErrorPtr();
+    }
+
+    virtual ErrorPtr start() P44_OVERRIDE
+    {
+      string chipPath = string_format(GPIO_CDEV_PATH "%d", mChipNo);
+      int chipFd = open(chipPath.c_str(), O_RDWR|O_CLOEXEC);
+      if (chipFd<0) return SysError::errNo(chipPath.c_str());
+      ErrorPtr err;
+      MLMicroSeconds now = MainLoop::now();
+      for (size_t first = 0; first<mOffsets.size(); first += GPIO_V2_LINES_MAX) {
+        // request a batch of lines with one fd
+        struct gpio_v2_line_request req;
+        memset(&req, 0, sizeof(req));
+        req.num_lines = (uint32_t)min((size_t)GPIO_V2_LINES_MAX, mOffsets.size()-first);
+        for (uint32_t i=0; i<req.num_lines; i++) req.offsets[i] = mOffsets[first+i];
+        strncpy(req.consumer, "p44featured", sizeof(req.consumer)-1);
+        req.config.flags = GPIO_V2_LINE_FLAG_INPUT|GPIO_V2_LINE_FLAG_EDGE_RISING|GPIO_V2_LINE_FLAG_EDGE_FALLING;
+        req.event_buffer_size = 16*req.num_lines;
+        if (ioctl(chipFd, GPIO_V2_GET_LINE_IOCTL, &req)<0) {
+          err = SysError::errNo("GPIO_V2_GET_LINE_IOCTL: ");
+          break;
+        }
+        mRequestFds.push_back(req.fd);
+        // lineEvents() drains until read() fails, must not block when exactly a buffer full was pending
+        fcntl(req.fd, F_SETFL, fcntl(req.fd, F_GETFL) | O_NONBLOCK);
+        // initial state
+        struct gpio_v2_line_values vals;
+        vals.mask = req.num_lines>=64 ? ~(uint64_t)0 : ((uint64_t)1<<req.num_lines)-1;
+        vals.bits = 0;
+        if (ioctl(req.fd, GPIO_V2_LINE_GET_VALUES_IOCTL, &vals)>=0) {
+          for (uint32_t i=0; i<req.num_lines; i++) {
+            mEngine.rawEdge(mLineIds[first+i], (vals.bits>>i) & 1, now);
+          }
+        }
+        MainLoop::currentMainLoop().registerPollHandler(req.fd, POLLIN, boost::bind(&CdevInputBackend::lineEvents, this, _1, _2));
+      }
+      close(chipFd);
+      return err;
+    }
+
+    virtual void stop() P44_OVERRIDE
+    {
+      for (vector<int>::iterator pos = mRequestFds.begin(); pos!=mRequestFds.end(); ++pos) {
+        MainLoop::currentMainLoop().unregisterPollHandler(*pos);
+        close(*pos);
+      }
+      mRequestFds.clear();
+    }
+
+    bool lineEvents(int aFD, int aPollFlags)
+    {
+      // read all pending events of all lines of this batch at once
+      struct gpio_v2_line_event events[16];
+      ssize_t n;
+      while ((n = read(aFD, events, sizeof(events)))>0) {
+        for (size_t i=0; i<n/sizeof(struct gpio_v2_line_event); i++) {
+          const struct gpio_v2_line_event &ev = events[i];
+          for (size_t k=0; k<mOffsets.size(); k++) {
+            if (mOffsets[k]==ev.offset) {
+              // Note: kernel timestamps are CLOCK_MONOTONIC by default, same as MainLoop::now()
+              mEngine.rawEdge(mLineIds[k], ev.id==GPIO_V2_LINE_EVENT_RISING_EDGE, (MLMicroSeconds)(ev.timestamp_ns/1000));
+              break;
+            }
+          }
+        }
+        if (n<(ssize_t)sizeof(events)) break;
+      }
+      return true;
+    }
+
+  };
+
+} // namespace p44
+
+#endif // INPUTENGINE_GPIO_CDEV
+
+
+// MARK: - InputEngine
+
+InputEngine::InputEngine(MLMicroSeconds aDebounceTime) :
+  mDebounceTime(aDebounceTime),
+  mStarted(false)
+{
+}
+
+
+InputEngine::~InputEngine()
+{
+  stop();
+}
+
+
+ErrorPtr InputEngine::addInput(const string aPinSpec, InputEdgeCB aEdgeCB, int &aLineId)
+{
+  if (mStarted) return TextError::err("cannot add inputs after start");
+  Line l;
+  l.pinSpec = aPinSpec;
+  l.inverted = false;
+  l.edgeCB = aEdgeCB;
+  l.stable = false;
+  l.current = false;
+  l.known = false;
+  l.deadUntil = Never;
+  string spec = aPinSpec;
+  if (spec.size()>0 && spec[0]=='/') {
+    l.inverted = true;
+    spec.erase(0,1);
+  }
+  size_t i = spec.find('.');
+  if (i==string::npos) return TextError::err("invalid input pinspec '%s'", aPinSpec.c_str());
+  string bus = spec.substr(0,i);
+  string name = spec.substr(i+1);
+  // one backend per bus (per chip for character devices)
+  BackendMap::iterator pos = mBackends.find(bus);
+  if (pos==mBackends.end()) {
+    InputBackendPtr backend;
+    int chipNo;
+    if (bus=="sim") {
+      backend = InputBackendPtr(new SimInputBackend(*this));
+    }
+    else if (bus=="gpio") {
+      backend = InputBackendPtr(new SysfsInputBackend(*this));
+    }
+    else if (sscanf(bus.c_str(), "gpiochip%d", &chipNo)==1) {
+      #if INPUTENGINE_GPIO_CDEV
+      backend = InputBackendPtr(new CdevInputBackend(*this, chipNo));
+      #else
+      return TextError::err("GPIO character device not supported on this platform: '%s'", aPinSpec.c_str());
+      #endif
+    }
+    else {
+      return TextError::err("unsupported input bus '%s'", bus.c_str());
+    }
+    pos = mBackends.insert(make_pair(bus, backend)).first;
+  }
+  l.backend = pos->second;
+  aLineId = (int)mLines.size();
+  ErrorPtr err = l.backend->addLine(aLineId, name);
+  if (Error::notOK(err)) return err;
+  mLines.push_back(l);
+  return ErrorPtr();
+}
+
+
+ErrorPtr InputEngine::start()
+{
+  if (mStarted) return ErrorPtr();
+  mStarted = true;
+  for (BackendMap::iterator pos = mBackends.begin(); pos!=mBackends.end(); ++pos) {
+    ErrorPtr err = pos->second->start();
+    if (Error::notOK(err)) {
+      LOG(LOG_ERR, "InputEngine: cannot start '%s' inputs: %s", pos->first.c_str(), err->text());
+      return err;
+    }
+  }
+  LOG(LOG_INFO, "InputEngine: started %d inputs with %d backend(s)", (int)mLines.size(), (int)mBackends.size());
+  return ErrorPtr();
+}
+
+
+void InputEngine::stop()
+{
+  mDebounceTicket.cancel();
+  for (BackendMap::iterator pos = mBackends.begin(); pos!=mBackends.end(); ++pos) {
+    pos->second->stop();
+  }
+  mStarted = false;
+}
+
+
+bool InputEngine::state(int aLineId) const
+{
+  if (aLineId<0 || aLineId>=(int)mLines.size()) return false;
+  return mLines[aLineId].stable;
+}
+
+
+void InputEngine::simulateEdge(int aLineId, bool aRawState)
+{
+  if (aLineId<0 || aLineId>=(int)mLines.size()) return;
+  if (!boost::dynamic_pointer_cast<SimInputBackend>(mLines[aLineId].backend)) return; // not a simulated line
+  rawEdge(aLineId, aRawState, MainLoop::now());
+}
+
+
+void InputEngine::rawEdge(int aLineId, bool aRawState, MLMicroSeconds aTimestamp)
+{
+  if (aLineId<0 || aLineId>=(int)mLines.size()) return;
+  Line &l = mLines[aLineId];
+  l.current = aRawState!=l.inverted;
+  if (!l.known) {
+    // initial state
+    l.known = true;
+    l.stable = l.current;
+    reportEdge(l, aLineId, aTimestamp);
+    return;
+  }
+  if (l.deadUntil!=Never) return; // still in dead time, debounceCheck() will pick up the final state
+  if (l.current!=l.stable) {
+    // leading edge debounce: report immediately (so short presses are never missed), then ignore bouncing
+    l.stable = l.current;
+    l.deadUntil = aTimestamp+mDebounceTime;
+    reportEdge(l, aLineId, aTimestamp);
+    scheduleDebounceCheck();
+  }
+}
+
+
+void InputEngine::reportEdge(Line &aLine, int aLineId, MLMicroSeconds aTimestamp)
+{
+  FOCUSLOG("InputEngine: '%s' -> %d", aLine.pinSpec.c_str(), aLine.stable);
+  if (aLine.edgeCB) aLine.edgeCB(aLineId, aLine.stable, aTimestamp);
+}
+
+
+void InputEngine::scheduleDebounceCheck()
+{
+  MLMicroSeconds next = Never;
+  for (LineVector::iterator pos = mLines.begin(); pos!=mLines.end(); ++pos) {
+    if (pos->deadUntil!=Never && (next==Never || pos->deadUntil<next)) next = pos->deadUntil;
+  }
+  if (next!=Never) {
+    mDebounceTicket.executeOnceAt(boost::bind(&InputEngine::debounceCheck, this), next);
+  }
+}
+
+
+void InputEngine::debounceCheck()
+{
+  MLMicroSeconds now = MainLoop::now();
+  for (int i=0; i<(int)mLines.size(); i++) {
+    Line &l = mLines[i];
+    if (l.deadUntil!=Never && l.deadUntil<=now) {
+      l.deadUntil = Never;
+      if (l.current!=l.stable) {
+        // input settled in a different state than last reported (e.g. release during dead time)
+        l.stable = l.current;
+        l.deadUntil = now+mDebounceTime;
+        reportEdge(l, i, now);
+      }
+    }
+  }
+  scheduleDebounceCheck();
+}
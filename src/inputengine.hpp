@@ -0,0 +1,148 @@
+//
+//  Copyright (c) 2026 plan44.ch / Lukas Zeller, Zurich, Switzerland
+//
+//  Author: Lukas Zeller <luz@plan44.ch>
+//
+//  This file is part of p44featured.
+//
+//  p44featured is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  p44featured is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with p44featured. If not, see <http://www.gnu.org/licenses/>.
+//
+
+#ifndef __p44featured__inputengine__
+#define __p44featured__inputengine__
+
+#include "p44utils_common.hpp"
+
+using namespace std;
+
+namespace p44 {
+
+  /// callback for debounced input edges
+  /// @param aLineId the line as returned by InputEngine::addInput()
+  /// @param aState new (debounced) state of the input, true = active
+  /// @param aTimestamp MainLoop::now() based time when the edge occurred
+  typedef boost::function<void (int aLineId, bool aState, MLMicroSeconds aTimestamp)> InputEdgeCB;
+
+  class InputEngine;
+  class InputBackend;
+  typedef boost::intrusive_ptr<InputBackend> InputBackendPtr;
+
+  /// base class for the hardware access part of the input engine
+  class InputBackend : public P44Obj
+  {
+    friend class InputEngine;
+
+  protected:
+
+    InputEngine &mEngine;
+
+    InputBackend(InputEngine &aEngine) : mEngine(aEngine) {};
+
+    /// add a line to this backend (before start())
+    /// @param aLineId the engine's id for the line, to be used in reporting edges
+    /// @param aLineName the backend specific line name (pinspec without bus prefix)
+    virtual ErrorPtr addLine(int aLineId, const string aLineName) = 0;
+
+    /// start event delivery. Backend must report the current state of all lines via InputEngine::rawEdge() once
+    virtual ErrorPtr start() = 0;
+
+    /// stop event delivery and release resources
+    virtual void stop() = 0;
+
+  public:
+
+    virtual ~InputBackend() {};
+
+  };
+
+
+  /// Event driven input engine.
+  /// Collects inputs from all backends, debounces them in one place and reports timestamped edges.
+  /// Pinspecs:
+  /// - `gpiochipN.offset`: Linux GPIO character device, all lines of a chip are requested in batches with one fd
+  /// - `gpio.N`: sysfs GPIO, edge triggered by poll(), used as a fallback
+  /// - `sim.name`: simulated input, changed via simulateEdge()
+  /// - prefix `/` inverts the input
+  class InputEngine : public P44Obj
+  {
+    typedef P44Obj inherited;
+    friend class InputBackend;
+
+    struct Line {
+      string pinSpec;
+      bool inverted;
+      InputBackendPtr backend;
+      InputEdgeCB edgeCB;
+      bool stable; ///< last reported state
+      bool current; ///< most recent raw state (after inversion)
+      bool known; ///< set when initial state has been reported
+      MLMicroSeconds deadUntil; ///< end of debounce dead time, Never if not debouncing
+    };
+    typedef vector<Line> LineVector;
+
+    LineVector mLines;
+    typedef map<string, InputBackendPtr> BackendMap;
+    BackendMap mBackends;
+    MLMicroSeconds mDebounceTime;
+    MLTicket mDebounceTicket;
+    bool mStarted;
+
+  public:
+
+    /// @param aDebounceTime dead time after a reported edge during which further edges are ignored
+    InputEngine(MLMicroSeconds aDebounceTime = 20*MilliSecond);
+    virtual ~InputEngine();
+
+    /// add an input
+    /// @param aPinSpec the input specification
+    /// @param aEdgeCB will be called with debounced edges, including once with the initial state after start()
+    /// @param aLineId will receive the id for the line
+    /// @return error if pinspec is not supported
+    ErrorPtr addInput(const string aPinSpec, InputEdgeCB aEdgeCB, int &aLineId);
+
+    /// start all backends
+    ErrorPtr start();
+
+    /// stop all backends
+    void stop();
+
+    /// @return current debounced state of a line
+    bool state(int aLineId) const;
+
+    /// @return number of lines
+    int numLines() const { return (int)mLines.size(); }
+
+    /// simulate a raw (undebounced) edge on a `sim.xxx` input
+    /// @param aLineId the line
+    /// @param aRawState the new raw (not inverted) state
+    void simulateEdge(int aLineId, bool aRawState);
+
+    /// report a raw edge (called by backends)
+    /// @param aLineId the line
+    /// @param aRawState raw state as read from hardware (not inverted)
+    /// @param aTimestamp MainLoop::now() based timestamp of the edge
+    void rawEdge(int aLineId, bool aRawState, MLMicroSeconds aTimestamp);
+
+  private:
+
+    void scheduleDebounceCheck();
+    void debounceCheck();
+    void reportEdge(Line &aLine, int aLineId, MLMicroSeconds aTimestamp);
+
+  };
+  typedef boost::intrusive_ptr<InputEngine> InputEnginePtr;
+
+} // namespace p44
+
+#endif /* defined(__p44featured__inputengine__) */
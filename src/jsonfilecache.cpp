@@ -0,0 +1,90 @@
+//
+//  Copyright (c) 2026 plan44.ch / Lukas Zeller, Zurich, Switzerland
+//
+//  Author: Lukas Zeller <luz@plan44.ch>
+//
+//  This file is part of p44featured.
+//
+//  p44featured is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  p44featured is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with p44featured. If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "jsonfilecache.hpp"
+#include "binjson.hpp"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+using namespace p44;
+
+
+static uint64_t fnv1a64(const uint8_t *aData, size_t aSize)
+{
+  uint64_t h = 0xcbf29ce484222325ULL;
+  for (size_t i=0; i<aSize; i++) {
+    h ^= aData[i];
+    h *= 0x100000001b3ULL;
+  }
+  return h;
+}
+
+
+ErrorPtr JsonFileCache::load(const string aPath, const string aCachePath, JsonObjectPtr &aJson, Stats *aStatsP)
+{
+  MLMicroSeconds start = MainLoop::now();
+  Stats stats;
+  stats.cached = false;
+  stats.parseTime = 0;
+  int fd = open(aPath.c_str(), O_RDONLY);
+  if (fd<0) return SysError::errNo("cannot open JSON file: ");
+  struct stat st;
+  if (fstat(fd, &st)!=0 || st.st_size==0) {
+    close(fd);
+    return TextError::err("empty JSON file '%s'", aPath.c_str());
+  }
+  void *m = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (m==MAP_FAILED) return SysError::errNo("cannot map JSON file: ");
+  const char *text = (const char *)m;
+  string key = string_format("%s:%lld:%016llx",
+    aPath.c_str(), (long long)st.st_mtime, (unsigned long long)fnv1a64((const uint8_t *)text, st.st_size)
+  );
+  ErrorPtr err;
+  JsonObjectPtr cached;
+  if (Error::isOK(BinJson::loadFile(aCachePath, cached, key)) && cached && cached->get("json", aJson)) {
+    JsonObjectPtr o;
+    if (cached->get("parse_us", o)) stats.parseTime = o->int64Value();
+    stats.cached = true;
+  }
+  else {
+    // parse the text (directly from the mapping, no copy) and rebuild the cache
+    MLMicroSeconds parseStart = MainLoop::now();
+    aJson = JsonObject::objFromText(text, st.st_size, &err, true);
+    stats.parseTime = MainLoop::now()-parseStart;
+    if (Error::isOK(err) && aJson) {
+      cached = JsonObject::newObj();
+      cached->add("parse_us", JsonObject::newInt64(stats.parseTime));
+      cached->add("json", aJson);
+      ErrorPtr cerr = BinJson::saveFile(aCachePath, cached, key);
+      if (Error::notOK(cerr)) {
+        LOG(LOG_WARNING, "cannot write JSON cache '%s': %s", aCachePath.c_str(), cerr->text());
+      }
+    }
+  }
+  munmap(m, st.st_size);
+  stats.loadTime = MainLoop::now()-start;
+  if (aStatsP) *aStatsP = stats;
+  return err;
+}
@@ -0,0 +1,56 @@
+//
+//  Copyright (c) 2026 plan44.ch / Lukas Zeller, Zurich, Switzerland
+//
+//  Author: Lukas Zeller <luz@plan44.ch>
+//
+//  This file is part of p44featured.
+//
+//  p44featured is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  p44featured is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with p44featured. If not, see <http://www.gnu.org/licenses/>.
+//
+
+#ifndef __p44featured__jsonfilecache__
+#define __p44featured__jsonfilecache__
+
+#include "p44utils_common.hpp"
+#include "jsonobject.hpp"
+
+using namespace std;
+
+namespace p44 {
+
+  /// Loads JSON text files via a pre-parsed binary cache (see BinJson).
+  /// The cache is keyed by file path, modification time and a hash of the content,
+  /// so any change to the text file makes the cache be rebuilt.
+  class JsonFileCache
+  {
+  public:
+
+    struct Stats {
+      bool cached; ///< set if loaded from the cache
+      MLMicroSeconds loadTime; ///< time needed to load
+      MLMicroSeconds parseTime; ///< time parsing the text took (when the cache was built)
+    };
+
+    /// load a JSON text file
+    /// @param aPath path of the JSON text file
+    /// @param aCachePath path of the cache file, will be created or updated as needed
+    /// @param aJson will receive the JSON
+    /// @param aStatsP if not NULL, receives statistics
+    static ErrorPtr load(const string aPath, const string aCachePath, JsonObjectPtr &aJson, Stats *aStatsP = NULL);
+
+  };
+
+} // namespace p44
+
+#endif /* defined(__p44featured__jsonfilecache__) */
@@ -27,6 +27,18 @@
 #include "ledchaincomm.hpp"
 #include "p44script.hpp"
 #include "expressions.hpp"
+#include "inputengine.hpp"
+#include "asynclogwriter.hpp"
+#include "handlerprofiler.hpp"
+#include "simhardware.hpp"
+#include "statesnapshot.hpp"
+#include "jsonfilecache.hpp"
+#include "allocstats.hpp"
+#include "inlinecb.hpp"
+#include "featureworker.hpp"
+#include "proxyfeature.hpp"
+#include "clusterclock.hpp"
+#include "commandscheduler.hpp"
 
 #include "light.hpp"
 #include "inputs.hpp"
@@ -39,14 +51,25 @@
 #include "rfids.hpp"
 #include "splitflaps.hpp"
 
+#if ENABLE_FEATURE_NEURON
+  #include "sensorsampler.hpp"
+#endif
+
 #if ENABLE_P44SCRIPT
   #include "httpcomm.hpp"
 #endif
 
 #if ENABLE_LEDARRANGEMENT
   #include "viewfactory.hpp"
+  #if ENABLE_PNG
+    #include "imageview.hpp"
+  #endif
 #endif
 
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
 #if ENABLE_UBUS
   #include "ubus.hpp"
 #endif
@@ -55,7 +78,17 @@
 using namespace p44;
 
 #define DEFAULT_LOGLEVEL LOG_NOTICE
+#define DEFAULT_ASYNCLOG_KB 256
+#define DEFAULT_STALL_BUDGET_MS 20
+#define PROFILER_PROBE_INTERVAL (10*MilliSecond)
 #define DEFAULT_COMM_PORT 2101
+#define FEATURE_INIT_SPACING (1*MilliSecond) // gives pending I/O (API requests) a chance between feature creations
+#define FEATURE_INIT_RETRY_MS 500 // retry hint for requests to features still being created
+#define ISOLATABLE_FEATURES "light,hermel,splitflaps" // self-contained features that send no event messages
+#define DEFAULT_CLUSTER_GROUP "239.255.44.1"
+#define DEFAULT_CLUSTER_PORT 4401
+#define DEFAULT_CLUSTER_FRAME_MS 20
+#define CLUSTER_SYNC_RETRY_MS 500 // retry hint for cluster timed requests while not yet synchronized
 
 #if ENABLE_UBUS
 static const struct blobmsg_policy logapi_policy[] = {
@@ -187,6 +220,40 @@ static void webrequest_func(BuiltinFunctionContextPtr f)
 
 #endif // ENABLE_P44SCRIPT
 
+// MARK: ==== Uploads
+
+/// read-only memory mapping of an uploaded file, so its content can be handed to the consumer without copying
+class MappedFile
+{
+  void *mData;
+  size_t mSize;
+
+public:
+
+  MappedFile() : mData(MAP_FAILED), mSize(0) {};
+  ~MappedFile() { if (mData!=MAP_FAILED) munmap(mData, mSize); }
+
+  ErrorPtr map(const string aPath)
+  {
+    int fd = open(aPath.c_str(), O_RDONLY);
+    if (fd<0) return SysError::errNo("cannot open uploaded file: ");
+    struct stat st;
+    if (fstat(fd, &st)!=0 || st.st_size==0) {
+      close(fd);
+      return WebError::webErr(415, "empty upload");
+    }
+    mSize = st.st_size;
+    mData = mmap(NULL, mSize, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mData==MAP_FAILED) return SysError::errNo("cannot map uploaded file: ");
+    return ErrorPtr();
+  }
+
+  const char *data() const { return (const char *)mData; }
+  size_t size() const { return mSize; }
+};
+
+
 // MARK: ==== Application
 
 #define MKSTR(s) _MKSTR(s)
@@ -200,10 +267,20 @@ class P44FeatureD : public CmdLineApp
   // P44 device management JSON API Server
   SocketCommPtr p44mgmtApiServer;
   int requestsPending;
+  struct PendingApiRequest {
+    JsonCommPtr connection;
+    size_t allocsAtStart;
+  };
+  CallbackSlots<PendingApiRequest> pendingApiRequests; ///< context for API request callbacks
+  CallbackSlots<RequestDoneCB> pendingScriptResults; ///< context for execcode result callbacks
+  uint64_t apiRequests; ///< completed mg44 API requests
+  uint64_t apiRequestAllocs; ///< allocations made while mg44 API requests were in progress
+  uint64_t lastApiRequestAllocs;
 
   #if ENABLE_UBUS
   // ubus API for P44 device management
   UbusServerPtr ubusApiServer;
+  CallbackSlots<UbusRequestPtr> pendingUbusRequests; ///< context for ubus feature API callbacks
   #endif
 
   #if ENABLE_LEDARRANGEMENT
@@ -219,19 +296,18 @@ class P44FeatureD : public CmdLineApp
 
   // LED+Button
   ButtonInputPtr button;
+  InputEnginePtr inputEngine; ///< event driven inputs, if any
+  int buttonLineId; ///< input engine line of the button, -1 if button is a ButtonInput
+  MLMicroSeconds lastButtonChange;
+  typedef std::map<int, string> InputNamesMap;
+  InputNamesMap engineInputNames; ///< input engine lines reported as input events, by line id
   IndicatorOutputPtr greenLed;
   IndicatorOutputPtr redLed;
 
   #if ENABLE_FEATURE_NEURON
   AnalogIoPtr sensor0;
   AnalogIoPtr sensor1;
-  #endif
-  #if ENABLE_FEATURE_LIGHT
-  AnalogIoPtr pwmDimmer;
-  #endif
-  #if ENABLE_FEATURE_HERMEL
-  AnalogIoPtr pwmLeft;
-  AnalogIoPtr pwmRight;
+  SensorSamplerPtr sensorSampler; ///< fixed rate sampler for the sensors, if enabled
   #endif
   #if ENABLE_FEATURE_RFIDS
   static const int maxRfidSelectorOutputs = 5;
@@ -240,8 +316,36 @@ class P44FeatureD : public CmdLineApp
   int selectedReader;
   #endif
 
+  // simulation
+  bool simulate; ///< use simulated instead of missing pins
+  std::list<string> simPinSpecs; ///< storage for generated sim pinspecs
+  typedef std::list<SimDevicePtr> SimDeviceList;
+  SimDeviceList simDevices; ///< simulated hardware endpoints
+
   FeatureApiPtr featureApi;
 
+  // deferred feature creation
+  typedef boost::function<FeaturePtr ()> FeatureFactoryCB;
+  typedef std::list<std::pair<string, FeatureFactoryCB> > FeatureFactoryList;
+  FeatureFactoryList pendingFeatures; ///< features not yet created, in creation order
+  MLTicket featureInitTicket;
+  MLMicroSeconds appStartedAt;
+  MLMicroSeconds startupCompletedAt; ///< Never while features are still being created
+  JsonObjectPtr featureInitTimes; ///< creation time per feature
+  JsonObjectPtr initJsonStats; ///< initjson loading statistics
+  string isolatedFeatures; ///< comma separated names of features to run on their own thread
+  typedef std::map<string, FeatureWorkerPtr> FeatureWorkerMap;
+  FeatureWorkerMap featureWorkers; ///< isolated features
+
+  // cluster
+  ClusterClockPtr clusterClock; ///< shared frame clock, NULL if not in a cluster
+  CommandSchedulerPtr commandScheduler; ///< for requests with "at" or "atframe"
+
+  // runtime state snapshot
+  StateSnapshotPtr snapshot; ///< set when --snapshot is used
+  MLMicroSeconds snapshotInterval; ///< interval for periodic snapshots, 0=only at exit
+  MLTicket snapshotTicket;
+
 public:
 
   P44FeatureD() :
@@ -249,8 +353,18 @@ public:
     mainScript(sourcecode+regular, "main"),
     #endif
     requestsPending(0),
+    apiRequests(0),
+    apiRequestAllocs(0),
+    lastApiRequestAllocs(0),
+    buttonLineId(-1),
+    lastButtonChange(Never),
+    simulate(false),
+    appStartedAt(Never),
+    startupCompletedAt(Never),
+    snapshotInterval(0),
     selectedReader(RFID522::Deselect)
   {
+    featureInitTimes = JsonObject::newObj();
     #if ENABLE_P44SCRIPT
     scriptApiLookup.isMemberVariable();
     StandardScriptingDomain::sharedDomain().registerMemberLookup(new FeatureApiLookup);
@@ -267,6 +381,23 @@ public:
 
   virtual bool processOption(const CmdLineOptionDescriptor &aOptionDescriptor, const char *aOptionValue)
   {
+    if (strcmp(aOptionDescriptor.longOptionName,"simledchain")==0) {
+      // must be started right away, before ledchains try to open the FIFO
+      #if ENABLE_LEDARRANGEMENT
+      if (ledChainArrangement) {
+        // the ledchain would already have opened (or created a plain file at) the device path
+        terminateAppWith(TextError::err("--simledchain must precede --ledchain"));
+        return true;
+      }
+      #endif
+      char path[256];
+      int numLeds = 100;
+      int usPerLed = 30;
+      if (sscanf(aOptionValue, "%255[^,],%d,%d", path, &numLeds, &usPerLed)>=1) {
+        addSimDevice(SimDevicePtr(new SimLedChainDevice(path, numLeds, usPerLed*MicroSecond)));
+      }
+    }
+    else
     #if ENABLE_LEDARRANGEMENT
     if (strcmp(aOptionDescriptor.longOptionName,"ledchain")==0) {
       LEDChainArrangement::addLEDChain(ledChainArrangement, aOptionValue);
@@ -292,6 +423,7 @@ public:
       { 0  , "neuron",         true,  "mvgAvgCnt,threshold,nAxonLeds,nBodyLeds;start neuron" },
       { 0  , "sensor0",        true,  "pinspec;analog sensor0 input to use" },
       { 0  , "sensor1",        true,  "pinspec;analog sensor1 input to use" },
+      { 0  , "sensorsampling", true,  "rate[,blocksize[,hysteresis]];sample sensors at fixed rate in a separate thread, fire neuron on threshold crossings" },
       #endif
       #if ENABLE_FEATURE_RFIDS
       { 0  , "rfidspibus",     true,  "spi_bus;SPI bus specification (10s=bus number, 1s=CS number)" },
@@ -342,21 +474,37 @@ public:
       { 0  , "mainscript",     true,  "p44scriptfile;the main script to run after startup" },
       #endif
       { 0  , "featuretool",    true,  "feature;start a feature's command line tool" },
+      { 0  , "isolatefeatures",true,  "feature[,feature...];run features on their own thread (only " ISOLATABLE_FEATURES ")" },
       { 0  , "jsonapiport",    true,  "port;server port number for management/web JSON API (default=none)" },
       { 0  , "jsonapinonlocal",false, "allow JSON API from non-local clients" },
       { 0  , "jsonapiipv6",    false, "JSON API on IPv6" },
       #if ENABLE_UBUS
       { 0  , "ubusapi",        false, "enable ubus API for management/web" },
       #endif
+      { 0  , "simulate",       false, "use simulated pins (sim.xxx) instead of missing pins for unspecified I/O" },
+      { 0  , "simserial",      true,  "port[,baud];simulated serial device at 127.0.0.1:port consuming data at baud rate (default=9600)" },
+      { 0  , "simledchain",    true,  "fifopath[,numleds[,uSperLED]];simulated WS281x ledchain FIFO to use as ledchain device path (must precede --ledchain)" },
       { 0  , "button",         true,  "input pinspec;device button" },
+      { 0  , "enginebutton",   false, "handle device button with the event driven input engine" },
+      { 0  , "inputengine",    true,  "name=pinspec[,name=pinspec...];event driven inputs (gpiochipN.offset, gpio.N, sim.name, / prefix inverts), reported as input events" },
+      { 0  , "inputdebounce",  true,  "milliseconds;debounce time for event driven inputs (default=20)" },
       { 0  , "greenled",       true,  "output pinspec;green device LED" },
       { 0  , "redled",         true,  "output pinspec;red device LED" },
+      { 0  , "profile",        true,  "budget_ms;profile mainloop handlers, log handlers exceeding budget as stalls (0=default budget), summary at exit" },
+      { 0  , "asynclog",       true,  "kbytes;write log output from a background thread via a lock-free buffer of given size (0=default size)" },
+      { 0  , "snapshot",       true,  "file[,seconds];save runtime state at exit (and periodically), restore it at startup" },
+      { 0  , "cluster",        true,  "master|follower[,group[:port][,frame_ms[,ifaddr]]];share a frame clock with other nodes via multicast, for feature API requests with \"atframe\" (default=239.255.44.1:4401, 20ms frames)" },
+      { 0  , "scheduleframe",  true,  "ms;frame interval feature API requests with \"at\" are aligned to when not in a cluster (default=20, 0=no alignment)" },
+      #if ENABLE_P44SCRIPT
+      { 0  , "snapshotvars",   true,  "name[,name...];script variables to include in the snapshot" },
+      #endif
       DAEMON_APPLICATION_LOGOPTIONS,
       CMDLINE_APPLICATION_PATHOPTIONS,
       CMDLINE_APPLICATION_STDOPTIONS,
       { 0, NULL } // list terminator
     };
 
+    appStartedAt = MainLoop::now();
     // parse the command line, exits when syntax errors occur
     setCommandDescriptors(usageText, options);
     parseCommandLine(argc, argv);
@@ -376,13 +524,93 @@ public:
       getIntOption("errlevel", errlevel);
       SETERRLEVEL(errlevel, !getOption("dontlogerrors"));
       SETDELTATIME(getOption("deltatstamps"));
-
+      simulate = getOption("simulate");
+      string simSerialSpec;
+      if (getStringOption("simserial", simSerialSpec)) {
+        int port = 0;
+        int baud = 9600;
+        if (sscanf(simSerialSpec.c_str(), "%d,%d", &port, &baud)>=1) {
+          addSimDevice(SimDevicePtr(new SimSerialDevice(port, baud)));
+        }
+      }
+      int asyncLogKb;
+      if (getIntOption("asynclog", asyncLogKb)) {
+        AsyncLogWriter::sharedWriter().start((asyncLogKb>0 ? asyncLogKb : DEFAULT_ASYNCLOG_KB)*1024, STDOUT_FILENO);
+      }
+      int stallBudgetMs;
+      if (getIntOption("profile", stallBudgetMs)) {
+        HandlerProfiler::sharedProfiler().enable((stallBudgetMs>0 ? stallBudgetMs : DEFAULT_STALL_BUDGET_MS)*MilliSecond, PROFILER_PROBE_INTERVAL);
+      }
+      string clusterSpec;
+      if (getStringOption("cluster", clusterSpec)) {
+        startClusterClock(clusterSpec);
+      }
+      ClusterClockPtr frameClock = clusterClock;
+      int scheduleFrameMs = DEFAULT_CLUSTER_FRAME_MS;
+      getIntOption("scheduleframe", scheduleFrameMs);
+      if (!frameClock && scheduleFrameMs>0) {
+        // not started, runs on local time
+        frameClock = ClusterClockPtr(new ClusterClock(true, "", 0, scheduleFrameMs*MilliSecond));
+      }
+      commandScheduler = CommandSchedulerPtr(new CommandScheduler(boost::bind(&P44FeatureD::dispatchFeatureRequest, this, _1, _2), frameClock));
+
+      // create event driven inputs
+      string engineInputs;
+      bool engineButton = getOption("enginebutton") && getOption("button");
+      if (getStringOption("inputengine", engineInputs) || engineButton) {
+        int debounceMs = 20;
+        getIntOption("inputdebounce", debounceMs);
+        inputEngine = InputEnginePtr(new InputEngine(debounceMs*MilliSecond));
+        const char *p = engineInputs.c_str();
+        string part;
+        while (nextPart(p, part, ',')) {
+          string name, pinspec;
+          if (!keyAndValue(part, name, pinspec, '=')) {
+            name = part;
+            pinspec = part;
+          }
+          int lineId;
+          ErrorPtr err = inputEngine->addInput(pinspec, boost::bind(&P44FeatureD::engineInputHandler, this, _1, _2, _3), lineId);
+          if (Error::notOK(err)) {
+            LOG(LOG_ERR, "cannot add input '%s': %s", part.c_str(), err->text());
+          }
+          else {
+            engineInputNames[lineId] = name;
+          }
+        }
+      }
       // create button input
-      button = ButtonInputPtr(new ButtonInput(getOption("button","missing")));
-      button->setButtonHandler(boost::bind(&P44FeatureD::buttonHandler, this, _1, _2, _3), true, Second);
+      if (engineButton) {
+        ErrorPtr err = inputEngine->addInput(getOption("button","missing"), boost::bind(&P44FeatureD::engineButtonHandler, this, _1, _2, _3), buttonLineId);
+        if (Error::notOK(err)) {
+          LOG(LOG_ERR, "cannot use input engine for device button: %s", err->text());
+          engineButton = false;
+        }
+      }
+      if (!engineButton) {
+        button = ButtonInputPtr(new ButtonInput(getOption("button", unusedPin("button"))));
+        button->setButtonHandler(boost::bind(&P44FeatureD::buttonHandler, this, _1, _2, _3), true, Second);
+      }
       // create LEDs
-      greenLed = IndicatorOutputPtr(new IndicatorOutput(getOption("greenled","missing")));
-      redLed = IndicatorOutputPtr(new IndicatorOutput(getOption("redled","missing")));
+      greenLed = IndicatorOutputPtr(new IndicatorOutput(getOption("greenled", unusedPin("greenled"))));
+      redLed = IndicatorOutputPtr(new IndicatorOutput(getOption("redled", unusedPin("redled"))));
+
+      // load last runtime state
+      string snapshotSpec;
+      if (getStringOption("snapshot", snapshotSpec)) {
+        int intervalS = 0;
+        size_t i = snapshotSpec.find(',');
+        if (i!=string::npos) {
+          intervalS = atoi(snapshotSpec.c_str()+i+1);
+          snapshotSpec.erase(i);
+        }
+        snapshotInterval = intervalS*Second;
+        snapshot = StateSnapshotPtr(new StateSnapshot(snapshotSpec));
+        ErrorPtr err = snapshot->load();
+        if (Error::notOK(err)) {
+          LOG(LOG_WARNING, "no snapshot restored: %s", err->text());
+        }
+      }
 
       #if ENABLE_LEDARRANGEMENT
       if (ledChainArrangement) {
@@ -399,67 +627,84 @@ public:
 
       // create API
       featureApi = FeatureApi::sharedApi();
-      // add features
+      // queue features for creation. Creating features can take a while (probing hardware),
+      // so this is done one by one from the mainloop once the API servers are running
       #if ENABLE_FEATURE_LIGHT
       // - light
-      pwmDimmer = AnalogIoPtr(new AnalogIo(getOption("pwmdimmer","missing"), true, 0)); // off to begin with
-      featureApi->addFeature(FeaturePtr(new Light(
-        pwmDimmer
-      )));
+      // Note: I/O objects are only referenced by the factory, so the feature can take them over on a worker thread
+      queueFeature("light", boost::bind(&P44FeatureD::newLight, this,
+        AnalogIoPtr(new AnalogIo(getOption("pwmdimmer", unusedPin("pwmdimmer")), true, 0)) // off to begin with
+      ));
       #endif
       #if ENABLE_FEATURE_INPUTS
       // - inputs (instantiate only with command line option, as it allows free use of GPIOs etc.)
       if (getOption("inputs")) {
-        featureApi->addFeature(FeaturePtr(new Inputs));
+        queueFeature("inputs", boost::bind(&P44FeatureD::newInputs, this));
       }
       #endif
       #if ENABLE_FEATURE_HERMEL
       // - hermel
-      pwmLeft = AnalogIoPtr(new AnalogIo(getOption("pwmleft","missing"), true, 0)); // off to begin with
-      pwmRight = AnalogIoPtr(new AnalogIo(getOption("pwmright","missing"), true, 0)); // off to begin with
-      featureApi->addFeature(FeaturePtr(new HermelShoot(
-        pwmLeft, pwmRight
-      )));
+      queueFeature("hermel", boost::bind(&P44FeatureD::newHermel, this,
+        AnalogIoPtr(new AnalogIo(getOption("pwmleft", unusedPin("pwmleft")), true, 0)), // off to begin with
+        AnalogIoPtr(new AnalogIo(getOption("pwmright", unusedPin("pwmright")), true, 0)) // off to begin with
+      ));
       #endif
       #if ENABLE_FEATURE_MIXLOOP
       // - mixloop
-      featureApi->addFeature(FeaturePtr(new MixLoop(
-        getOption("ledchain2","/dev/null"),
-        getOption("ledchain3","/dev/null")
-      )));
+      queueFeature("mixloop", boost::bind(&P44FeatureD::newMixLoop, this,
+        string(getOption("ledchain2","/dev/null")),
+        string(getOption("ledchain3","/dev/null"))
+      ));
       #endif
       #if ENABLE_FEATURE_WIFITRACK
       // - wifitrack
-      featureApi->addFeature(FeaturePtr(new WifiTrack(
-        getOption("wifimonif","")
-      )));
+      queueFeature("wifitrack", boost::bind(&P44FeatureD::newWifiTrack, this,
+        string(getOption("wifimonif",""))
+      ));
       #endif
       #if ENABLE_FEATURE_NEURON
       // - neuron
-      sensor0 =  AnalogIoPtr(new AnalogIo(getOption("sensor0","missing"), false, 0));
-      featureApi->addFeature(FeaturePtr(new Neuron(
-        getOption("ledchain1","/dev/null"),
-        getOption("ledchain2","/dev/null"),
-        sensor0
-      )));
+      sensor0 =  AnalogIoPtr(new AnalogIo(getOption("sensor0", unusedPin("sensor0")), false, 0));
+      AnalogIoPtr neuronSensor = sensor0;
+      string samplingSpec;
+      if (getStringOption("sensorsampling", samplingSpec)) {
+        // sensors are sampled at fixed rate by a separate thread, neuron only gets the threshold crossings
+        double rate = 100;
+        int blockSize = 1;
+        double hysteresis = 0;
+        sscanf(samplingSpec.c_str(), "%lf,%d,%lf", &rate, &blockSize, &hysteresis);
+        int mvgAvgCnt = 10;
+        double threshold = 250;
+        string neuronSpec;
+        if (getStringOption("neuron", neuronSpec)) {
+          sscanf(neuronSpec.c_str(), "%d,%lf", &mvgAvgCnt, &threshold);
+        }
+        sensorSampler = SensorSamplerPtr(new SensorSampler(rate, blockSize));
+        sensorSampler->addChannel(sensor0, mvgAvgCnt, threshold, hysteresis);
+        if (getOption("sensor1")) {
+          sensor1 = AnalogIoPtr(new AnalogIo(getOption("sensor1","missing"), false, 0));
+          sensorSampler->addChannel(sensor1, mvgAvgCnt, threshold, hysteresis);
+        }
+        neuronSensor = AnalogIoPtr(new AnalogIo("missing", false, 0)); // prevent neuron from polling the sensor itself
+      }
+      queueFeature("neuron", boost::bind(&P44FeatureD::newNeuron, this,
+        string(getOption("ledchain1","/dev/null")),
+        string(getOption("ledchain2","/dev/null")),
+        neuronSensor
+      ));
       #endif
       #if ENABLE_FEATURE_DISPMATRIX
       // - dispmatrix
-      featureApi->addFeature(FeaturePtr(new DispMatrix(ledChainArrangement)));
+      queueFeature("dispmatrix", boost::bind(&P44FeatureD::newDispMatrix, this));
       #endif
       #if ENABLE_FEATURE_INDICATORS
       // - indicators
-      featureApi->addFeature(FeaturePtr(new Indicators(ledChainArrangement)));
+      queueFeature("indicators", boost::bind(&P44FeatureD::newIndicators, this));
       #endif
       #if ENABLE_FEATURE_RFIDS
       // - RFIDs
       int spibusno;
       if (getIntOption("rfidspibus", spibusno)) {
-        // bus device
-        SPIDevicePtr spiBusDevice = SPIManager::sharedManager().getDevice(spibusno, "generic@0");
-        // reset
-        DigitalIoPtr resetPin = DigitalIoPtr(new DigitalIo(getOption("rfidreset","missing"), true, false)); // ResetN active to start with
-        DigitalIoPtr irqPin = DigitalIoPtr(new DigitalIo(getOption("rfidirq","missing"), false, true)); // assume high (open drain)
         // selector
         numRfidSelectorOutputs = 0;
         string s;
@@ -473,13 +718,11 @@ public:
             rfidSelectorOutputs[numRfidSelectorOutputs++] = DigitalIoPtr(new DigitalIo(pinspec.c_str(), true, true)); // all 1 initially -> none selected
           }
         }
-        // add
-        featureApi->addFeature(FeaturePtr(new RFIDs(
-          spiBusDevice,
-          boost::bind(&P44FeatureD::rfidSelector, this, _1),
-          resetPin,
-          irqPin
-        )));
+        // bus device and reset/irq pins
+        SPIDevicePtr spiBusDevice = SPIManager::sharedManager().getDevice(spibusno, "generic@0");
+        DigitalIoPtr resetPin = DigitalIoPtr(new DigitalIo(getOption("rfidreset", unusedPin("rfidreset")), true, false)); // ResetN active to start with
+        DigitalIoPtr irqPin = DigitalIoPtr(new DigitalIo(getOption("rfidirq", unusedPin("rfidirq")), false, true)); // assume high (open drain)
+        queueFeature("rfids", boost::bind(&P44FeatureD::newRFIDs, this, spiBusDevice, resetPin, irqPin));
       }
       #endif // ENABLE_FEATURE_RFIDS
       #if ENABLE_FEATURE_SPLITFLAPS
@@ -490,16 +733,16 @@ public:
         getStringOption("splitflaptxen", tx);
         getStringOption("splitflaprxen", rx);
         getIntOption("splitflaptxoff", txoffdelay);
-        // add
-        featureApi->addFeature(FeaturePtr(new Splitflaps(
-          s.c_str(), DEFAULT_COMM_PORT,
-          tx.c_str(), rx.c_str(), txoffdelay
-        )));
+        queueFeature("splitflaps", boost::bind(&P44FeatureD::newSplitflaps, this, s, tx, rx, txoffdelay));
       }
       #endif // ENABLE_FEATURE_SPLITFLAPS
       // use feature tools, if specified
       string featuretool;
       if (getStringOption("featuretool", featuretool)) {
+        // tools need the features right now
+        while (!pendingFeatures.empty()) {
+          createFeature(pendingFeatures.begin());
+        }
         FeaturePtr tf = featureApi->getFeature(featuretool);
         if (tf) {
           terminateAppWith(tf->runTool());
@@ -509,29 +752,20 @@ public:
         }
       }
       if (!isTerminated()) {
-        // run the initialisation command file
-        #if ENABLE_LEGACY_FEATURE_SCRIPTS
-        string initJson;
-        if (getStringOption("initjson", initJson)) {
-          ErrorPtr err = featureApi->runJsonFile(initJson);
-          if (!Error::isOK(err)) {
-            terminateAppWith(err);
-          }
-        }
-        #endif
-        #if EXPRESSION_JSON_SUPPORT
-        string initScriptFn;
-        if (getStringOption("initscript", initScriptFn)) {
-          string initScript;
-          ErrorPtr err = string_fromfile(initScriptFn, initScript);
-          if (!Error::isOK(err)) {
-            terminateAppWith(err->withPrefix("cannot open initscript: "));
-          }
-          else {
-            featureApi->queueScript("initscript", initScript);
+        // features to isolate (not for tools, these need the feature on the main thread)
+        if (getStringOption("isolatefeatures", isolatedFeatures)) {
+          // - features sending events would call FeatureApi from their worker thread
+          const char *p = isolatedFeatures.c_str();
+          string f;
+          while (nextPart(p, f, ',')) {
+            if (!inNameList(ISOLATABLE_FEATURES, f)) {
+              terminateAppWith(TextError::err("--isolatefeatures: feature '%s' cannot run on its own thread, only " ISOLATABLE_FEATURES " can", f.c_str()));
+              break;
+            }
           }
         }
-        #endif
+      }
+      if (!isTerminated()) {
         #if ENABLE_P44SCRIPT
         if (getStringOption("mainscript", mainScriptFn)) {
           string code;
@@ -548,6 +782,7 @@ public:
         }
         #endif
         // start p44featured TCP API server
+        // - features not yet created are represented by placeholders answering with "retry later"
         string apiport;
         if (getStringOption("featureapiport", apiport)) {
           featureApi->start(apiport);
@@ -582,6 +817,93 @@ public:
       LOG(LOG_INFO, "ubus server started");
     }
     #endif
+    if (inputEngine) {
+      ErrorPtr err = inputEngine->start();
+      if (Error::notOK(err)) {
+        // explicitly configured inputs that do not work are a configuration error
+        terminateAppWith(err->withPrefix("cannot start event driven inputs: "));
+        return;
+      }
+    }
+    #if ENABLE_FEATURE_NEURON
+    if (sensorSampler) {
+      sensorSampler->start(boost::bind(&P44FeatureD::sensorThresholdHandler, this, _1, _2, _3, _4));
+    }
+    #endif
+    // now create the features, API requests are served in between
+    featureInitTicket.executeOnce(boost::bind(&P44FeatureD::createNextFeature, this));
+  }
+
+
+  /// called when all features exist, runs the init files and the main script
+  virtual void startupComplete()
+  {
+    if (snapshot && snapshotInterval>0) {
+      snapshotTicket.executeOnce(boost::bind(&P44FeatureD::periodicSnapshot, this), snapshotInterval);
+    }
+    startupCompletedAt = MainLoop::now();
+    LOG(LOG_NOTICE, "all features created, %lld mS after start", (long long)((startupCompletedAt-appStartedAt)/MilliSecond));
+    runInitJson();
+  }
+
+
+  /// run the initialisation command file, then continue with runInitScript()
+  void runInitJson()
+  {
+    #if ENABLE_LEGACY_FEATURE_SCRIPTS
+    string initJson;
+    if (getStringOption("initjson", initJson)) {
+      // load pre-parsed from cache when possible
+      // - resolve relative paths against the resource path, like FeatureApi::runJsonFile() does
+      JsonObjectPtr initCmds;
+      JsonFileCache::Stats stats;
+      ErrorPtr err = JsonFileCache::load(resourcePath(initJson), dataPath("initjson.cache"), initCmds, &stats);
+      if (Error::isOK(err)) {
+        MLMicroSeconds saved = stats.cached ? stats.parseTime-stats.loadTime : 0;
+        LOG(LOG_NOTICE, "initjson loaded in %lld uS%s, %lld uS saved by cache", (long long)stats.loadTime, stats.cached ? " from cache" : "", (long long)saved);
+        initJsonStats = JsonObject::newObj();
+        initJsonStats->add("cached", JsonObject::newBool(stats.cached));
+        initJsonStats->add("load_us", JsonObject::newInt64(stats.loadTime));
+        initJsonStats->add("parse_us", JsonObject::newInt64(stats.parseTime));
+        initJsonStats->add("saved_us", JsonObject::newInt64(saved));
+        err = featureApi->runJsonScript(initCmds, boost::bind(&P44FeatureD::runInitScript, this));
+      }
+      if (!Error::isOK(err)) {
+        terminateAppWith(err);
+      }
+      return;
+    }
+    #endif
+    runInitScript();
+  }
+
+
+  /// run the initialisation script, then continue with initScriptsDone()
+  void runInitScript()
+  {
+    #if EXPRESSION_JSON_SUPPORT
+    string initScriptFn;
+    if (getStringOption("initscript", initScriptFn)) {
+      string initScript;
+      ErrorPtr err = string_fromfile(initScriptFn, initScript);
+      if (!Error::isOK(err)) {
+        terminateAppWith(err->withPrefix("cannot open initscript: "));
+        return;
+      }
+      featureApi->queueScript("initscript", initScript, boost::bind(&P44FeatureD::initScriptsDone, this));
+      return;
+    }
+    #endif
+    initScriptsDone();
+  }
+
+
+  /// initjson and initscript have completed
+  void initScriptsDone()
+  {
+    // re-apply the state from before the restart on top of what the init scripts did,
+    // but before the main script starts, so it sees the restored variables
+    restoreSnapshot();
     #if ENABLE_P44SCRIPT
     LOG(LOG_INFO, "starting main script");
     mainScript.run(stopall, boost::bind(&P44FeatureD::mainScriptEndHandler, this, _1));
@@ -590,6 +912,468 @@ public:
   }
 
 
+  virtual void cleanup(int aExitCode)
+  {
+    if (snapshot && startupCompletedAt!=Never) {
+      // only when fully started, a partial state would overwrite the previous snapshot
+      saveSnapshot();
+    }
+    if (inputEngine) inputEngine->stop();
+    for (SimDeviceList::iterator pos = simDevices.begin(); pos!=simDevices.end(); ++pos) {
+      (*pos)->stop();
+    }
+    #if ENABLE_FEATURE_NEURON
+    if (sensorSampler) sensorSampler->stop();
+    #endif
+    for (FeatureWorkerMap::iterator pos = featureWorkers.begin(); pos!=featureWorkers.end(); ++pos) {
+      pos->second->stop();
+    }
+    if (commandScheduler) commandScheduler->stop();
+    if (clusterClock) clusterClock->stop();
+    inherited::cleanup(aExitCode);
+    if (HandlerProfiler::sharedProfiler().isEnabled()) {
+      LOG(LOG_NOTICE, "%s", HandlerProfiler::sharedProfiler().summary().c_str());
+    }
+    AsyncLogWriter::sharedWriter().stop(); // last, to get all messages out
+  }
+
+
+  // MARK: ==== Feature creation
+
+
+  void queueFeature(const char *aName, FeatureFactoryCB aFactory)
+  {
+    pendingFeatures.push_back(make_pair(string(aName), aFactory));
+    // until created, requests arriving via FeatureApi get a retryable answer
+    // Note: FeatureApi::addFeature() replaces the placeholder with the real feature (same name)
+    featureApi->addFeature(FeaturePtr(new ProxyFeature(aName, boost::bind(&P44FeatureD::pendingFeatureRequest, this, string(aName), _1))));
+  }
+
+
+  /// request to a feature not yet created, via FeatureApi
+  void pendingFeatureRequest(const string aName, ApiRequestPtr aRequest)
+  {
+    if (featurePending(aName)) {
+      retryLater(aName, boost::bind(&ApiRequest::sendResponse, aRequest, _1, _2));
+      return;
+    }
+    aRequest->sendResponse(JsonObjectPtr(), WebError::webErr(500, "feature '%s' could not be created", aName.c_str()));
+  }
+
+
+  /// answer a request to a feature not yet created
+  void retryLater(const string aName, RequestDoneCB aRequestDoneCB)
+  {
+    JsonObjectPtr retry = JsonObject::newObj();
+    retry->add("retryafter", JsonObject::newInt32(FEATURE_INIT_RETRY_MS));
+    aRequestDoneCB(retry, WebError::webErr(503, "feature '%s' is being initialized, retry later", aName.c_str()));
+  }
+
+
+  void createFeature(FeatureFactoryList::iterator aPos)
+  {
+    string name = aPos->first;
+    FeatureFactoryCB factory = aPos->second;
+    pendingFeatures.erase(aPos);
+    MLMicroSeconds start = MainLoop::now();
+    if (isIsolated(name)) {
+      // feature gets created on its worker thread
+      FeatureWorkerPtr worker = FeatureWorkerPtr(new FeatureWorker(name, factory, boost::bind(&P44FeatureD::isolatedFeatureCreated, this, name, _1)));
+      // - the worker now owns the factory and the I/O objects bound into it
+      factory = FeatureFactoryCB();
+      ErrorPtr err = worker->start();
+      if (Error::isOK(err)) {
+        featureWorkers[name] = worker;
+        // requests from all APIs and scripts reach the worker through FeatureApi
+        // Note: FeatureApi::addFeature() replaces the placeholder (same name)
+        featureApi->addFeature(FeaturePtr(new ProxyFeature(name, boost::bind(&P44FeatureD::isolatedFeatureRequest, this, name, _1))));
+        return;
+      }
+      // worker thread did not start, feature was not created
+      LOG(LOG_ERR, "cannot run feature '%s' on its own thread: %s", name.c_str(), err->text());
+      return;
+    }
+    FeaturePtr feature = factory();
+    MLMicroSeconds duration = MainLoop::now()-start;
+    if (feature) featureApi->addFeature(feature);
+    featureInitTimes->add(name.c_str(), JsonObject::newInt64(duration));
+    LOG(LOG_INFO, "feature '%s' created in %lld uS", name.c_str(), (long long)duration);
+  }
+
+
+  void createNextFeature()
+  {
+    if (pendingFeatures.empty()) {
+      startupComplete();
+      return;
+    }
+    createFeature(pendingFeatures.begin());
+    featureInitTicket.executeOnce(boost::bind(&P44FeatureD::createNextFeature, this), FEATURE_INIT_SPACING);
+  }
+
+
+  /// an isolated feature was created on its worker thread
+  void isolatedFeatureCreated(const string aName, MLMicroSeconds aCreationTime)
+  {
+    featureInitTimes->add(aName.c_str(), JsonObject::newInt64(aCreationTime));
+  }
+
+
+  /// request to an isolated feature via FeatureApi, forwarded to its worker thread
+  void isolatedFeatureRequest(const string aName, ApiRequestPtr aRequest)
+  {
+    FeatureWorkerMap::iterator pos = featureWorkers.find(aName);
+    if (pos==featureWorkers.end()) {
+      aRequest->sendResponse(JsonObjectPtr(), WebError::webErr(500, "feature '%s' has no worker", aName.c_str()));
+      return;
+    }
+    pos->second->handleRequest(aRequest->getRequest(), boost::bind(&ApiRequest::sendResponse, aRequest, _1, _2));
+  }
+
+
+  bool isIsolated(const string aName)
+  {
+    return inNameList(isolatedFeatures, aName);
+  }
+
+
+  /// @return true if aName is in the comma separated aList
+  static bool inNameList(const string aList, const string aName)
+  {
+    const char *p = aList.c_str();
+    string f;
+    while (nextPart(p, f, ',')) {
+      if (f==aName) return true;
+    }
+    return false;
+  }
+
+
+  void startClusterClock(const string aSpec)
+  {
+    const char *p = aSpec.c_str();
+    string role, group = DEFAULT_CLUSTER_GROUP, ifaddr, part;
+    int port = DEFAULT_CLUSTER_PORT;
+    int frameMs = DEFAULT_CLUSTER_FRAME_MS;
+    nextPart(p, role, ',');
+    if (nextPart(p, part, ',') && !part.empty()) {
+      size_t i = part.find(':');
+      group = part.substr(0, i);
+      if (i!=string::npos) port = atoi(part.c_str()+i+1);
+    }
+    if (nextPart(p, part, ',') && !part.empty()) frameMs = atoi(part.c_str());
+    nextPart(p, ifaddr, ',');
+    if (role!="master" && role!="follower") {
+      terminateAppWith(TextError::err("--cluster: role must be 'master' or 'follower'"));
+      return;
+    }
+    clusterClock = ClusterClockPtr(new ClusterClock(role=="master", group, port, frameMs*MilliSecond, ifaddr));
+    ErrorPtr err = clusterClock->start();
+    if (Error::notOK(err)) {
+      terminateAppWith(err->withPrefix("cannot start cluster clock: "));
+    }
+  }
+
+
+  /// schedule a request carrying "at" (seconds, "clock":"unix" (default) or "monotonic") or "atframe"
+  /// Note: the scheduler works in frame clock time (the master's mainloop time in a cluster)
+  void scheduleFeatureRequest(JsonObjectPtr aRequest, RequestDoneCB aRequestDoneCB)
+  {
+    JsonObjectPtr o;
+    MLMicroSeconds when;
+    bool align = true;
+    if (aRequest->get("atframe", o)) {
+      if (!clusterClock) {
+        aRequestDoneCB(JsonObjectPtr(), WebError::webErr(400, "atframe needs --cluster"));
+        return;
+      }
+      if (!clusterClock->synchronized()) {
+        retryUnsynchronized(aRequestDoneCB);
+        return;
+      }
+      when = clusterClock->clusterTimeOfFrame(o->int64Value());
+      align = false; // is a frame start already
+    }
+    else {
+      aRequest->get("at", o);
+      MLMicroSeconds t = o->doubleValue()*Second;
+      string clock = "unix";
+      JsonObjectPtr c;
+      if (aRequest->get("clock", c)) clock = c->stringValue();
+      if (clock=="unix") {
+        when = commandScheduler->clockTime(MainLoop::unixTimeToMainLoopTime(t));
+      }
+      else if (clock=="monotonic") {
+        // the frame clock's time, which is the master's mainloop time in a cluster
+        if (clusterClock && !clusterClock->synchronized()) {
+          retryUnsynchronized(aRequestDoneCB);
+          return;
+        }
+        when = t;
+      }
+      else {
+        aRequestDoneCB(JsonObjectPtr(), WebError::webErr(400, "clock must be 'unix' or 'monotonic'"));
+        return;
+      }
+    }
+    aRequest->del("at");
+    aRequest->del("atframe");
+    aRequest->del("clock");
+    ErrorPtr err = commandScheduler->schedule(aRequest, aRequestDoneCB, when, align);
+    if (Error::notOK(err)) aRequestDoneCB(JsonObjectPtr(), err);
+  }
+
+
+  /// answer a request timed in cluster time while the offset to the master is not yet known
+  void retryUnsynchronized(RequestDoneCB aRequestDoneCB)
+  {
+    JsonObjectPtr retry = JsonObject::newObj();
+    retry->add("retryafter", JsonObject::newInt32(CLUSTER_SYNC_RETRY_MS));
+    aRequestDoneCB(retry, WebError::webErr(503, "cluster clock not synchronized yet, retry later"));
+  }
+
+
+  JsonObjectPtr workerMetrics()
+  {
+    JsonObjectPtr m = JsonObject::newObj();
+    for (FeatureWorkerMap::iterator pos = featureWorkers.begin(); pos!=featureWorkers.end(); ++pos) {
+      m->add(pos->first.c_str(), pos->second->stats());
+    }
+    return m;
+  }
+
+
+  /// @return true if the feature is not yet created. If so, it is moved to the front of the queue
+  bool featurePending(const string aName)
+  {
+    for (FeatureFactoryList::iterator pos = pendingFeatures.begin(); pos!=pendingFeatures.end(); ++pos) {
+      if (pos->first==aName) {
+        // requested feature gets created next
+        pendingFeatures.splice(pendingFeatures.begin(), pendingFeatures, pos);
+        return true;
+      }
+    }
+    return false;
+  }
+
+
+  JsonObjectPtr startupMetrics()
+  {
+    JsonObjectPtr m = JsonObject::newObj();
+    m->add("features_us", featureInitTimes);
+    m->add("pending", JsonObject::newInt32((int)pendingFeatures.size()));
+    if (initJsonStats) m->add("initjson", initJsonStats);
+    if (startupCompletedAt!=Never) {
+      m->add("completed_us", JsonObject::newInt64(startupCompletedAt-appStartedAt));
+    }
+    return m;
+  }
+
+
+  #if ENABLE_FEATURE_LIGHT
+  FeaturePtr newLight(AnalogIoPtr aPwmDimmer)
+  {
+    return FeaturePtr(new Light(aPwmDimmer));
+  }
+  #endif
+
+  #if ENABLE_FEATURE_INPUTS
+  FeaturePtr newInputs()
+  {
+    return FeaturePtr(new Inputs);
+  }
+  #endif
+
+  #if ENABLE_FEATURE_HERMEL
+  FeaturePtr newHermel(AnalogIoPtr aPwmLeft, AnalogIoPtr aPwmRight)
+  {
+    return FeaturePtr(new HermelShoot(aPwmLeft, aPwmRight));
+  }
+  #endif
+
+  #if ENABLE_FEATURE_MIXLOOP
+  FeaturePtr newMixLoop(const string aLedChain2, const string aLedChain3)
+  {
+    return FeaturePtr(new MixLoop(aLedChain2.c_str(), aLedChain3.c_str()));
+  }
+  #endif
+
+  #if ENABLE_FEATURE_WIFITRACK
+  FeaturePtr newWifiTrack(const string aMonitorIf)
+  {
+    return FeaturePtr(new WifiTrack(aMonitorIf.c_str()));
+  }
+  #endif
+
+  #if ENABLE_FEATURE_NEURON
+  FeaturePtr newNeuron(const string aLedChain1, const string aLedChain2, AnalogIoPtr aSensor)
+  {
+    return FeaturePtr(new Neuron(aLedChain1.c_str(), aLedChain2.c_str(), aSensor));
+  }
+  #endif
+
+  #if ENABLE_FEATURE_DISPMATRIX
+  FeaturePtr newDispMatrix()
+  {
+    return FeaturePtr(new DispMatrix(ledChainArrangement));
+  }
+  #endif
+
+  #if ENABLE_FEATURE_INDICATORS
+  FeaturePtr newIndicators()
+  {
+    return FeaturePtr(new Indicators(ledChainArrangement));
+  }
+  #endif
+
+  #if ENABLE_FEATURE_RFIDS
+  FeaturePtr newRFIDs(SPIDevicePtr aSpiBusDevice, DigitalIoPtr aResetPin, DigitalIoPtr aIrqPin)
+  {
+    return FeaturePtr(new RFIDs(
+      aSpiBusDevice,
+      boost::bind(&P44FeatureD::rfidSelector, this, _1),
+      aResetPin,
+      aIrqPin
+    ));
+  }
+  #endif
+
+  #if ENABLE_FEATURE_SPLITFLAPS
+  FeaturePtr newSplitflaps(const string aConn, const string aTxEnable, const string aRxEnable, int aTxOffDelay)
+  {
+    return FeaturePtr(new Splitflaps(
+      aConn.c_str(), DEFAULT_COMM_PORT,
+      aTxEnable.c_str(), aRxEnable.c_str(), aTxOffDelay
+    ));
+  }
+  #endif
+
+
+  // MARK: ==== State snapshot
+
+
+  void saveSnapshot()
+  {
+    MLMicroSeconds start = MainLoop::now();
+    JsonObjectPtr viewStatus;
+    #if ENABLE_LEDARRANGEMENT && ENABLE_VIEWSTATUS
+    if (ledChainArrangement && ledChainArrangement->getRootView()) {
+      viewStatus = ledChainArrangement->getRootView()->viewStatus();
+    }
+    #endif
+    JsonObjectPtr vars;
+    #if ENABLE_P44SCRIPT
+    string varNames;
+    if (getStringOption("snapshotvars", varNames)) {
+      vars = JsonObject::newObj();
+      const char *p = varNames.c_str();
+      string name;
+      while (nextPart(p, name, ',')) {
+        ScriptObjPtr v = mainScriptContext->memberByName(name);
+        if (!v) v = StandardScriptingDomain::sharedDomain().memberByName(name);
+        if (v && !v->isErr()) vars->add(name.c_str(), v->jsonValue());
+      }
+    }
+    #endif
+    ErrorPtr err = snapshot->save(viewStatus, vars);
+    if (Error::notOK(err)) {
+      LOG(LOG_ERR, "cannot save snapshot: %s", err->text());
+      return;
+    }
+    LOG(LOG_INFO, "snapshot saved in %lld uS", (long long)(MainLoop::now()-start));
+  }
+
+
+  void periodicSnapshot()
+  {
+    saveSnapshot();
+    snapshotTicket.executeOnce(boost::bind(&P44FeatureD::periodicSnapshot, this), snapshotInterval);
+  }
+
+
+  /// re-apply the state loaded from the snapshot: feature init parameters, then the view, then script variables
+  void restoreSnapshot()
+  {
+    if (!snapshot || !snapshot->restorePending()) return;
+    snapshot->apply(
+      boost::bind(&P44FeatureD::restoreSnapshotFeature, this, _1, _2),
+      boost::bind(&P44FeatureD::restoreSnapshotView, this, _1),
+      boost::bind(&P44FeatureD::restoreSnapshotVar, this, _1, _2)
+    );
+    LOG(LOG_NOTICE, "runtime state restored from snapshot");
+  }
+
+
+  void restoreSnapshotFeature(const string aFeatureName, JsonObjectPtr aInitRequest)
+  {
+    LOG(LOG_INFO, "restoring feature '%s' from snapshot", aFeatureName.c_str());
+    dispatchFeatureRequest(aInitRequest, boost::bind(&P44FeatureD::snapshotRestoreDone, this, aFeatureName, _1, _2));
+  }
+
+
+  void restoreSnapshotView(JsonObjectPtr aViewStatus)
+  {
+    #if ENABLE_LEDARRANGEMENT && ENABLE_VIEWSTATUS
+    if (!ledChainArrangement) return;
+    P44ViewPtr rootView;
+    ErrorPtr err = createViewFromConfig(aViewStatus, rootView, P44ViewPtr());
+    if (Error::notOK(err) || !rootView) {
+      LOG(LOG_WARNING, "cannot restore view from snapshot: %s", Error::notOK(err) ? err->text() : "no view");
+      return;
+    }
+    ledChainArrangement->setRootView(rootView);
+    #endif
+  }
+
+
+  void restoreSnapshotVar(const string aVarName, JsonObjectPtr aValue)
+  {
+    #if ENABLE_P44SCRIPT
+    StandardScriptingDomain::sharedDomain().setMemberByName(aVarName, ScriptObj::valueFromJSON(aValue));
+    #endif
+  }
+
+
+  void snapshotRestoreDone(const string aFeatureName, JsonObjectPtr aResponse, ErrorPtr aError)
+  {
+    if (Error::notOK(aError)) {
+      LOG(LOG_WARNING, "restoring feature '%s' from snapshot failed: %s", aFeatureName.c_str(), aError->text());
+    }
+  }
+
+
+  void featureInitDone(const string aFeatureName, JsonObjectPtr aInitRequest, RequestDoneCB aRequestDoneCB, JsonObjectPtr aResponse, ErrorPtr aError)
+  {
+    if (Error::isOK(aError) && snapshot) {
+      snapshot->recordInit(aFeatureName, aInitRequest);
+    }
+    if (aRequestDoneCB) aRequestDoneCB(aResponse, aError);
+  }
+
+
+  // MARK: ==== Simulation
+
+
+  /// @return pinspec to use for pins not specified on the command line
+  const char *unusedPin(const char *aName)
+  {
+    if (!simulate) return "missing";
+    simPinSpecs.push_back(string("sim.")+aName);
+    return simPinSpecs.back().c_str();
+  }
+
+
+  void addSimDevice(SimDevicePtr aSimDevice)
+  {
+    ErrorPtr err = aSimDevice->start();
+    if (Error::notOK(err)) {
+      LOG(LOG_ERR, "cannot start simulated device '%s': %s", aSimDevice->name().c_str(), err->text());
+      return;
+    }
+    simDevices.push_back(aSimDevice);
+  }
+
+
   void mainScriptEndHandler(ScriptObjPtr aMainScriptExitCode)
   {
     if (aMainScriptExitCode->hasType(numeric)) {
@@ -609,10 +1393,63 @@ public:
 
   void buttonHandler(bool aState, bool aHasChanged, MLMicroSeconds aTimeSincePreviousChange)
   {
+    ScopedHandlerTiming t("button");
     LOG(LOG_INFO, "Button state now %d%s", aState, aHasChanged ? " (changed)" : " (same)");
   }
 
 
+  void engineButtonHandler(int aLineId, bool aState, MLMicroSeconds aTimestamp)
+  {
+    MLMicroSeconds sincePrevious = lastButtonChange==Never ? Never : aTimestamp-lastButtonChange;
+    lastButtonChange = aTimestamp;
+    buttonHandler(aState, true, sincePrevious);
+  }
+
+
+  // MARK: ==== Event driven inputs
+
+  void engineInputHandler(int aLineId, bool aState, MLMicroSeconds aTimestamp)
+  {
+    ScopedHandlerTiming t("input");
+    InputNamesMap::iterator pos = engineInputNames.find(aLineId);
+    if (pos==engineInputNames.end()) return;
+    LOG(LOG_INFO, "input '%s' now %d", pos->second.c_str(), aState);
+    JsonObjectPtr message = JsonObject::newObj();
+    message->add("feature", JsonObject::newString("inputs"));
+    message->add("input", JsonObject::newString(pos->second));
+    message->add("value", JsonObject::newBool(aState));
+    message->add("timestamp", JsonObject::newInt64(MainLoop::mainLoopTimeToUnixTime(aTimestamp)/MilliSecond));
+    featureApi->sendMessage(message);
+  }
+
+
+  // MARK: ==== Sensor sampling
+
+
+  #if ENABLE_FEATURE_NEURON
+
+  void sensorThresholdHandler(int aChannel, bool aAbove, double aAverage, MLMicroSeconds aWhen)
+  {
+    ScopedHandlerTiming t("sensor");
+    LOG(LOG_INFO, "sensor%d average %.1f went %s threshold (%lld uS ago)", aChannel, aAverage, aAbove ? "above" : "below", (long long)(MainLoop::now()-aWhen));
+    if (aAbove) {
+      JsonObjectPtr cmd = JsonObject::newObj();
+      cmd->add("feature", JsonObject::newString("neuron"));
+      cmd->add("cmd", JsonObject::newString("fire"));
+      dispatchFeatureRequest(cmd, boost::bind(&P44FeatureD::sensorFireDone, this, _1, _2));
+    }
+  }
+
+  void sensorFireDone(JsonObjectPtr aResponse, ErrorPtr aError)
+  {
+    if (Error::notOK(aError)) {
+      LOG(LOG_WARNING, "firing neuron from sensor failed: %s", aError->text());
+    }
+  }
+
+  #endif
+
+
   // MARK: ==== RFID selector
 
 
@@ -651,6 +1488,7 @@ public:
 
   void ubusApiRequestHandler(UbusRequestPtr aUbusRequest, const string aMethod, JsonObjectPtr aJsonRequest)
   {
+    ScopedHandlerTiming t("ubus.", aMethod);
     if (aMethod=="log") {
       if (aJsonRequest) {
         JsonObjectPtr o;
@@ -672,19 +1510,16 @@ public:
       aUbusRequest->sendResponse(JsonObjectPtr());
     }
     else if (aMethod=="featureapi") {
-      ErrorPtr err;
-      JsonObjectPtr result;
+      int slot = pendingUbusRequests.put(aUbusRequest);
       if (aJsonRequest) {
         // run on featureAPI
         LOG(LOG_INFO,"ubus feature API request: %s", aJsonRequest->c_strValue());
-        ApiRequestPtr req = ApiRequestPtr(new APICallbackRequest(aJsonRequest, boost::bind(&P44FeatureD::ubusFeatureApiRequestDone, this, aUbusRequest, _1, _2)));
-        featureApi->handleRequest(req);
+        dispatchFeatureRequest(aJsonRequest, inlineCB([this, slot](JsonObjectPtr aResult, ErrorPtr aError) {
+          ubusFeatureApiRequestDone(slot, aResult, aError);
+        }));
         return;
       }
-      else {
-        err = TextError::err("missing API command object");
-      }
-      ubusFeatureApiRequestDone(aUbusRequest, result, err);
+      ubusFeatureApiRequestDone(slot, JsonObjectPtr(), TextError::err("missing API command object"));
     }
     else {
       // no other methods implemented yet
@@ -692,13 +1527,18 @@ public:
     }
   }
 
-  void ubusFeatureApiRequestDone(UbusRequestPtr aUbusRequest, JsonObjectPtr aResult, ErrorPtr aError)
+  void ubusFeatureApiRequestDone(int aSlot, JsonObjectPtr aResult, ErrorPtr aError)
   {
+    UbusRequestPtr ubusRequest = pendingUbusRequests.take(aSlot);
+    if (!ubusRequest) {
+      LOG(LOG_ERR, "ubus feature API answer without pending request (callback fired twice?)");
+      return;
+    }
     JsonObjectPtr response = JsonObject::newObj();
     if (aResult) response->add("result", aResult);
     if (aError) response->add("error", JsonObject::newString(aError->description()));
     LOG(LOG_INFO,"ubus feature API answer: %s", response->c_strValue());
-    aUbusRequest->sendResponse(response);
+    ubusRequest->sendResponse(response);
   }
 
 
@@ -720,6 +1560,9 @@ public:
 
   void apiRequestHandler(JsonCommPtr aConnection, ErrorPtr aError, JsonObjectPtr aRequest)
   {
+    ScopedHandlerTiming t("api.request");
+    PendingApiRequest pending = { aConnection, AllocStats::allocations() };
+    int slot = pendingApiRequests.put(pending);
     // Decode mg44-style request (HTTP wrapped in JSON)
     if (Error::isOK(aError)) {
       LOG(LOG_INFO,"mg44 API request: %s", aRequest->c_strValue());
@@ -761,13 +1604,19 @@ public:
           }
           if (upload) {
             // move that into the request
+            if (!data) data = JsonObject::newObj();
             data->add("uploadedfile", JsonObject::newString(uploadedfile));
           }
         }
         // request elements now: uri and data
         requestsPending++;
         LOG(LOG_INFO, "+++ New request pending, total now %d", requestsPending);
-        if (processRequest(uri, data, action, boost::bind(&P44FeatureD::requestHandled, this, aConnection, _1, _2))) {
+        if (upload && uri=="upload") {
+          // uploaded file is handed to its consumer directly
+          requestHandled(slot, JsonObjectPtr(), processUpload(uri, data, uploadedfile));
+          return;
+        }
+        if (processRequest(uri, data, action, inlineCB([this, slot](JsonObjectPtr aResponse, ErrorPtr aError) { requestHandled(slot, aResponse, aError); }))) {
           // done, callback will send response and close connection
           return;
         }
@@ -782,12 +1631,19 @@ public:
       }
     }
     // return error
-    requestHandled(aConnection, JsonObjectPtr(), aError);
+    requestHandled(slot, JsonObjectPtr(), aError);
   }
 
 
-  void requestHandled(JsonCommPtr aConnection, JsonObjectPtr aResponse, ErrorPtr aError)
+  void requestHandled(int aSlot, JsonObjectPtr aResponse, ErrorPtr aError)
   {
+    ScopedHandlerTiming t("api.response");
+    PendingApiRequest pending = pendingApiRequests.take(aSlot);
+    JsonCommPtr connection = pending.connection;
+    if (!connection) {
+      LOG(LOG_ERR, "mg44 API answer without pending request (callback fired twice?)");
+      return;
+    }
     requestsPending--;
     LOG(LOG_INFO, "--- Request handled, remaining pending now %d", requestsPending);
     if (!aResponse) {
@@ -797,8 +1653,27 @@ public:
       aResponse->add("error", JsonObject::newString(aError->description()));
     }
     LOG(LOG_INFO,"mg44 API answer: %s", aResponse->c_strValue());
-    aConnection->sendMessage(aResponse);
-    aConnection->closeAfterSend();
+    connection->sendMessage(aResponse);
+    connection->closeAfterSend();
+    // Note: includes allocations of other activities while the request was pending
+    // - size_t difference, correct across counter wrap-around
+    lastApiRequestAllocs = (size_t)(AllocStats::allocations()-pending.allocsAtStart);
+    apiRequestAllocs += lastApiRequestAllocs;
+    apiRequests++;
+  }
+
+
+  JsonObjectPtr allocMetrics()
+  {
+    JsonObjectPtr m = JsonObject::newObj();
+    m->add("enabled", JsonObject::newBool(AllocStats::enabled()));
+    m->add("allocations", JsonObject::newInt64(AllocStats::allocations()));
+    m->add("live", JsonObject::newInt64((size_t)(AllocStats::allocations()-AllocStats::deallocations())));
+    m->add("bytes", JsonObject::newInt64(AllocStats::bytes()));
+    m->add("apirequests", JsonObject::newInt64(apiRequests));
+    m->add("per_apirequest", JsonObject::newDouble(apiRequests>0 ? (double)apiRequestAllocs/apiRequests : 0));
+    m->add("last_apirequest", JsonObject::newInt64(lastApiRequestAllocs));
+    return m;
   }
 
 
@@ -824,11 +1699,46 @@ public:
     }
     aRequestDoneCB(ans, ErrorPtr());
   }
+
+  void scriptExecDone(int aSlot, ScriptObjPtr aResult)
+  {
+    RequestDoneCB doneCB = pendingScriptResults.take(aSlot);
+    if (!doneCB) {
+      LOG(LOG_ERR, "execcode result without pending request (callback fired twice?)");
+      return;
+    }
+    scriptExecHandler(doneCB, aResult);
+  }
   #endif
 
 
+  /// dispatch a request to the feature API
+  void dispatchFeatureRequest(JsonObjectPtr aRequest, RequestDoneCB aRequestDoneCB)
+  {
+    JsonObjectPtr o = aRequest ? aRequest->get("feature") : JsonObjectPtr();
+    ScopedHandlerTiming t("featureapi.", o ? o->stringValue() : "api");
+    JsonObjectPtr c;
+    if (aRequest && commandScheduler && (aRequest->get("at", c) || aRequest->get("atframe", c))) {
+      // timed request, comes back here when due
+      scheduleFeatureRequest(aRequest, aRequestDoneCB);
+      return;
+    }
+    if (o && featurePending(o->stringValue())) {
+      // not yet created, tell caller to retry
+      retryLater(o->stringValue(), aRequestDoneCB);
+      return;
+    }
+    if (o && snapshot && aRequest->get("cmd", c) && c->stringValue()=="init") {
+      // remember a copy of the feature's parameters for the snapshot, once the feature has accepted them
+      aRequestDoneCB = boost::bind(&P44FeatureD::featureInitDone, this, o->stringValue(), JsonObject::objFromText(aRequest->json_c_str()), aRequestDoneCB, _1, _2);
+    }
+    featureApi->handleRequest(ApiRequestPtr(new APICallbackRequest(aRequest, aRequestDoneCB)));
+  }
+
+
   bool processRequest(string aUri, JsonObjectPtr aData, bool aIsAction, RequestDoneCB aRequestDoneCB)
   {
+    ScopedHandlerTiming t("api.", aUri);
     ErrorPtr err;
     JsonObjectPtr o;
     if (aUri=="featureapi") {
@@ -837,8 +1747,33 @@ public:
         aRequestDoneCB(JsonObjectPtr(), WebError::webErr(415, "p44featured API calls must be action-type (e.g. POST)"));
         return true;
       }
-      ApiRequestPtr req = ApiRequestPtr(new APICallbackRequest(aData, aRequestDoneCB));
-      featureApi->handleRequest(req);
+      dispatchFeatureRequest(aData, aRequestDoneCB);
+      return true;
+    }
+    else if (aUri=="metrics") {
+      JsonObjectPtr metrics = JsonObject::newObj();
+      metrics->add("profile", HandlerProfiler::sharedProfiler().metrics());
+      JsonObjectPtr asyncLog = JsonObject::newObj();
+      asyncLog->add("written", JsonObject::newInt64(AsyncLogWriter::sharedWriter().written()));
+      asyncLog->add("dropped", JsonObject::newInt64(AsyncLogWriter::sharedWriter().dropped()));
+      metrics->add("asynclog", asyncLog);
+      metrics->add("requestspending", JsonObject::newInt32(requestsPending));
+      metrics->add("startup", startupMetrics());
+      metrics->add("alloc", allocMetrics());
+      if (!featureWorkers.empty()) metrics->add("workers", workerMetrics());
+      if (clusterClock) metrics->add("cluster", clusterClock->stats());
+      if (commandScheduler) metrics->add("scheduler", commandScheduler->stats());
+      if (!simDevices.empty()) {
+        JsonObjectPtr sim = JsonObject::newObj();
+        for (SimDeviceList::iterator pos = simDevices.begin(); pos!=simDevices.end(); ++pos) {
+          sim->add((*pos)->name().c_str(), (*pos)->stats());
+        }
+        metrics->add("sim", sim);
+      }
+      if (aIsAction && aData && aData->get("reset", o) && o->boolValue()) {
+        HandlerProfiler::sharedProfiler().reset();
+      }
+      aRequestDoneCB(metrics, ErrorPtr());
       return true;
     }
     else if (aUri=="log") {
@@ -859,7 +1794,8 @@ public:
         ScriptSource src(sourcecode+regular+keepvars+concurrently+floatingGlobs, "execcode");
         src.setSource(o->stringValue());
         src.setSharedMainContext(mainScriptContext);
-        src.run(inherit, boost::bind(&P44FeatureD::scriptExecHandler, this, aRequestDoneCB, _1));
+        int slot = pendingScriptResults.put(aRequestDoneCB);
+        src.run(inherit, inlineCB([this, slot](ScriptObjPtr aResult) { scriptExecDone(slot, aResult); }));
         return true;
       }
       bool newCode = false;
@@ -878,7 +1814,12 @@ public:
           LOG(LOG_INFO, "Checked global main script: syntax OK");
           if (aData->get("save", o) && o->boolValue()) {
             // save the script
-            err = string_tofile(dataPath(mainScriptFn), mainScript.getSource());
+            if (mainScriptFn.empty()) {
+              err = WebError::webErr(500, "no --mainscript file to save to");
+            }
+            else {
+              err = string_tofile(dataPath(mainScriptFn), mainScript.getSource());
+            }
           }
         }
         else {
@@ -923,29 +1864,99 @@ public:
 
   ErrorPtr processUpload(string aUri, JsonObjectPtr aData, const string aUploadedFile)
   {
+    ScopedHandlerTiming t("api.upload");
     ErrorPtr err;
 
     string cmd;
     JsonObjectPtr o;
-    if (aData->get("cmd", o, true)) {
-      cmd = o->stringValue();
-//      if (cmd=="imageupload") {
-//        displayPage->loadPNGBackground(aUploadedFile);
-//        gotoPage("display", false);
-//        updateDisplay();
-//      }
-//      else
-      {
-        err = WebError::webErr(500, "Unknown upload cmd '%s'", cmd.c_str());
+    if (!aData || !aData->get("cmd", o, true)) {
+      return WebError::webErr(415, "missing upload cmd");
+    }
+    cmd = o->stringValue();
+    #if ENABLE_P44SCRIPT
+    if (cmd=="scriptupload") {
+      // new main script
+      // - the script source must own its text, so read the file straight into it (no mapping needed)
+      string code;
+      err = string_fromfile(aUploadedFile, code);
+      if (Error::notOK(err)) return err;
+      mainScriptContext->abort(stopall);
+      mainScript.setSource(code);
+      ScriptObjPtr res = mainScript.syntaxcheck();
+      if (res && res->isErr()) {
+        return WebError::webErr(415, "Error in uploaded main script: %s", res->errorValue()->text());
+      }
+      if (aData->get("save", o) && o->boolValue()) {
+        // move the upload in place, write only if on a different file system
+        if (mainScriptFn.empty()) {
+          err = WebError::webErr(500, "no --mainscript file to save to");
+        }
+        else if (rename(aUploadedFile.c_str(), dataPath(mainScriptFn).c_str())!=0) {
+          err = string_tofile(dataPath(mainScriptFn), mainScript.getSource());
+        }
+      }
+      if (aData->get("run", o) && o->boolValue()) {
+        LOG(LOG_NOTICE, "Starting uploaded main script");
+        mainScript.run(stopall);
+      }
+    }
+    else
+    #endif // ENABLE_P44SCRIPT
+    #if ENABLE_LEDARRANGEMENT
+    if (cmd=="viewconfig") {
+      // (large) view configuration, parsed directly from the mapped upload
+      P44ViewPtr view = uploadTargetView(aData, err);
+      if (!view) return err;
+      MappedFile upload;
+      err = upload.map(aUploadedFile);
+      if (Error::notOK(err)) return err;
+      JsonObjectPtr cfg = JsonObject::objFromText(upload.data(), upload.size(), &err, true);
+      if (Error::isOK(err) && cfg) {
+        err = view->configureView(cfg);
       }
     }
+    else
+    #if ENABLE_PNG
+    if (cmd=="imageupload") {
+      // PNG is decoded by the image view straight from the uploaded file into its pixel buffer
+      P44ViewPtr view = uploadTargetView(aData, err);
+      if (!view) return err;
+      ImageView *iv = dynamic_cast<ImageView *>(view.get());
+      if (!iv) return WebError::webErr(415, "view '%s' is not an image view", view->getLabel().c_str());
+      err = iv->loadPNG(aUploadedFile);
+    }
+    else
+    #endif // ENABLE_PNG
+    #endif // ENABLE_LEDARRANGEMENT
+    {
+      err = WebError::webErr(500, "Unknown upload cmd '%s'", cmd.c_str());
+    }
     return err;
   }
 
+
+  #if ENABLE_LEDARRANGEMENT
+
+  /// @return the view labelled by "view" in aData, or the root view if not specified
+  P44ViewPtr uploadTargetView(JsonObjectPtr aData, ErrorPtr &aErr)
+  {
+    P44ViewPtr view = ledChainArrangement ? ledChainArrangement->getRootView() : P44ViewPtr();
+    JsonObjectPtr o;
+    if (view && aData->get("view", o, true)) {
+      view = view->getView(o->stringValue());
+    }
+    if (!view) aErr = WebError::webErr(404, "no such view");
+    return view;
+  }
+
+  #endif // ENABLE_LEDARRANGEMENT
+
 };
 
 
 
+#if !P44FEATURED_NO_MAIN
+
 int main(int argc, char **argv)
 {
   // prevent debug output before application.main scans command line
@@ -956,3 +1967,5 @@ int main(int argc, char **argv)
   // pass control
   return application.main(argc, argv);
 }
+
+#endif // !P44FEATURED_NO_MAIN
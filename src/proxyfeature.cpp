@@ -0,0 +1,45 @@
+//
+//  Copyright (c) 2026 plan44.ch / Lukas Zeller, Zurich, Switzerland
+//
+//  Author: Lukas Zeller <luz@plan44.ch>
+//
+//  This file is part of p44featured.
+//
+//  p44featured is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  p44featured is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with p44featured. If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "proxyfeature.hpp"
+
+using namespace p44;
+
+
+ProxyFeature::ProxyFeature(const string aName, RequestHandlerCB aHandler) :
+  inherited(aName),
+  mHandler(aHandler)
+{
+}
+
+
+ErrorPtr ProxyFeature::processRequest(ApiRequestPtr aRequest)
+{
+  if (!mHandler) return TextError::err("feature '%s' is not available", getName().c_str());
+  mHandler(aRequest);
+  return ErrorPtr(); // handler sends the response
+}
+
+
+ErrorPtr ProxyFeature::initialize(JsonObjectPtr aInitData)
+{
+  return TextError::err("feature '%s' must be initialized via processRequest()", getName().c_str());
+}
@@ -0,0 +1,67 @@
+//
+//  Copyright (c) 2026 plan44.ch / Lukas Zeller, Zurich, Switzerland
+//
+//  Author: Lukas Zeller <luz@plan44.ch>
+//
+//  This file is part of p44featured.
+//
+//  p44featured is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  p44featured is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with p44featured. If not, see <http://www.gnu.org/licenses/>.
+//
+
+#ifndef __p44featured__proxyfeature__
+#define __p44featured__proxyfeature__
+
+#include "p44utils_common.hpp"
+#include "featureapi.hpp"
+
+using namespace std;
+
+namespace p44 {
+
+  class ProxyFeature;
+  typedef boost::intrusive_ptr<ProxyFeature> ProxyFeaturePtr;
+
+  /// Stands in for a feature in FeatureApi and passes all its requests to a handler, so requests
+  /// from every entry point (feature API TCP port, scripts, mg44, ubus) reach it.
+  /// Used as placeholder for features not yet created, and for features running on a worker thread.
+  class ProxyFeature : public Feature
+  {
+    typedef Feature inherited;
+
+  public:
+
+    /// must send the response via aRequest->sendResponse(), now or later
+    typedef boost::function<void (ApiRequestPtr aRequest)> RequestHandlerCB;
+
+  private:
+
+    RequestHandlerCB mHandler;
+
+  public:
+
+    /// @param aName name of the feature represented
+    /// @param aHandler handles all requests to the feature
+    ProxyFeature(const string aName, RequestHandlerCB aHandler);
+
+    /// passes the request to the handler
+    virtual ErrorPtr processRequest(ApiRequestPtr aRequest) P44_OVERRIDE;
+
+    /// never called, init requests are passed to the handler like all others
+    virtual ErrorPtr initialize(JsonObjectPtr aInitData) P44_OVERRIDE;
+
+  };
+
+} // namespace p44
+
+#endif /* defined(__p44featured__proxyfeature__) */
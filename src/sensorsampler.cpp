@@ -0,0 +1,247 @@
+//
+//  Copyright (c) 2026 plan44.ch / Lukas Zeller, Zurich, Switzerland
+//
+//  Author: Lukas Zeller <luz@plan44.ch>
+//
+//  This file is part of p44featured.
+//
+//  p44featured is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  p44featured is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with p44featured. If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "sensorsampler.hpp"
+
+#include <time.h>
+#include <errno.h>
+
+using namespace p44;
+
+
+// MARK: - deadline helpers
+
+static void addNs(struct timespec &aTs, long aNs)
+{
+  aTs.tv_nsec += aNs;
+  while (aTs.tv_nsec>=1000000000L) {
+    aTs.tv_nsec -= 1000000000L;
+    aTs.tv_sec++;
+  }
+}
+
+
+static bool isPast(const struct timespec &aTs, const struct timespec &aNow)
+{
+  return aTs.tv_sec<aNow.tv_sec || (aTs.tv_sec==aNow.tv_sec && aTs.tv_nsec<=aNow.tv_nsec);
+}
+
+
+static void sleepUntil(const struct timespec &aDeadline)
+{
+  #if defined(__APPLE__)
+  // no clock_nanosleep on macOS, use relative sleep
+  struct timespec now, rel;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  if (isPast(aDeadline, now)) return;
+  rel.tv_sec = aDeadline.tv_sec-now.tv_sec;
+  rel.tv_nsec = aDeadline.tv_nsec-now.tv_nsec;
+  if (rel.tv_nsec<0) { rel.tv_nsec += 1000000000L; rel.tv_sec--; }
+  nanosleep(&rel, NULL);
+  #else
+  while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &aDeadline, NULL)==EINTR);
+  #endif
+}
+
+
+// MARK: - SensorSampler
+
+SensorSampler::SensorSampler(double aSampleRate, size_t aBlockSize) :
+  mInterval(aSampleRate>0 ? (MLMicroSeconds)(Second/aSampleRate) : 10*MilliSecond),
+  mBlockSize(aBlockSize>0 ? aBlockSize : 1),
+  mOverruns(0)
+{
+  pthread_mutex_init(&mMutex, NULL);
+}
+
+
+SensorSampler::~SensorSampler()
+{
+  stop();
+  pthread_mutex_destroy(&mMutex);
+}
+
+
+int SensorSampler::addChannel(AnalogIoPtr aSensor, size_t aMvgAvgCnt, double aThreshold, double aHysteresis)
+{
+  Channel ch;
+  ch.sensor = aSensor;
+  ch.window.resize(aMvgAvgCnt>0 ? aMvgAvgCnt : 1, 0);
+  ch.pos = 0;
+  ch.filled = 0;
+  ch.sum = 0;
+  ch.threshold = aThreshold;
+  ch.hysteresis = aHysteresis;
+  ch.above = false;
+  ch.lastAverage = 0;
+  mChannels.push_back(ch);
+  return (int)mChannels.size()-1;
+}
+
+
+double SensorSampler::average(int aChannel) const
+{
+  if (aChannel<0 || aChannel>=(int)mChannels.size()) return 0;
+  pthread_mutex_lock(&mMutex);
+  double avg = mChannels[aChannel].lastAverage;
+  pthread_mutex_unlock(&mMutex);
+  return avg;
+}
+
+
+void SensorSampler::processSamples(const double *aSamples, const MLMicroSeconds *aTimes, SensorThresholdCB aThresholdCB)
+{
+  if (mSamplerThread || mChannels.empty()) return;
+  mThresholdCB = aThresholdCB;
+  mBlock.assign(aSamples, aSamples+mBlockSize*mChannels.size());
+  mBlockTimes.assign(aTimes, aTimes+mBlockSize);
+  if (processBlock()) deliverCrossings();
+}
+
+
+void SensorSampler::start(SensorThresholdCB aThresholdCB)
+{
+  if (mSamplerThread || mChannels.empty()) return;
+  mThresholdCB = aThresholdCB;
+  mBlock.resize(mBlockSize*mChannels.size());
+  mBlockTimes.resize(mBlockSize);
+  LOG(LOG_INFO, "SensorSampler: starting %d channel(s) at %.1f samples/sec, block size %d",
+    (int)mChannels.size(), (double)Second/mInterval, (int)mBlockSize
+  );
+  mSamplerThread = MainLoop::currentMainLoop().executeInThread(
+    boost::bind(&SensorSampler::samplerThread, this, _1),
+    boost::bind(&SensorSampler::samplerThreadSignal, this, _1, _2)
+  );
+}
+
+
+void SensorSampler::stop()
+{
+  if (mSamplerThread) {
+    mSamplerThread->terminate();
+    mSamplerThread.reset();
+    LOG(LOG_INFO, "SensorSampler: stopped, %ld missed sample deadlines", overruns());
+  }
+}
+
+
+void SensorSampler::samplerThread(ChildThreadWrapper &aThread)
+{
+  struct timespec deadline, now;
+  clock_gettime(CLOCK_MONOTONIC, &deadline);
+  size_t nc = mChannels.size();
+  size_t bi = 0;
+  while (!aThread.shouldTerminate()) {
+    addNs(deadline, (long)(mInterval*1000));
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    if (isPast(deadline, now)) {
+      // missed the deadline (reading the inputs took too long), resync instead of bursting
+      mOverruns.fetch_add(1, std::memory_order_relaxed);
+      deadline = now;
+    }
+    else {
+      sleepUntil(deadline);
+    }
+    // read all channels as close together as possible
+    double *sp = &mBlock[bi*nc];
+    for (size_t i=0; i<nc; ++i) {
+      sp[i] = mChannels[i].sensor->value();
+    }
+    mBlockTimes[bi] = MainLoop::now();
+    if (++bi>=mBlockSize) {
+      bi = 0;
+      if (processBlock()) {
+        aThread.signalParentThread(threadSignalUserSignal);
+      }
+    }
+  }
+}
+
+
+bool SensorSampler::processBlock()
+{
+  bool crossed = false;
+  size_t nc = mChannels.size();
+  for (size_t i=0; i<nc; ++i) {
+    Channel &ch = mChannels[i];
+    size_t wsz = ch.window.size();
+    const double *sp = &mBlock[i];
+    double avg = 0;
+    for (size_t b=0; b<mBlockSize; ++b, sp += nc) {
+      // running sum: replace oldest sample by new one
+      double v = *sp;
+      if (ch.filled<wsz) ch.filled++;
+      else ch.sum -= ch.window[ch.pos];
+      ch.window[ch.pos] = v;
+      ch.sum += v;
+      if (++ch.pos>=wsz) {
+        ch.pos = 0;
+        // once per window wrap, recalculate the sum to prevent floating point drift
+        double s = 0;
+        for (size_t k=0; k<wsz; ++k) s += ch.window[k];
+        ch.sum = s;
+      }
+      avg = ch.sum/ch.filled;
+      if (ch.above ? avg<ch.threshold-ch.hysteresis : avg>ch.threshold) {
+        ch.above = !ch.above;
+        Crossing c;
+        c.channel = (int)i;
+        c.above = ch.above;
+        c.average = avg;
+        c.when = mBlockTimes[b];
+        pthread_mutex_lock(&mMutex);
+        mCrossings.push_back(c);
+        pthread_mutex_unlock(&mMutex);
+        crossed = true;
+      }
+    }
+    // publish once per block, not per sample
+    pthread_mutex_lock(&mMutex);
+    ch.lastAverage = avg;
+    pthread_mutex_unlock(&mMutex);
+  }
+  return crossed;
+}
+
+
+void SensorSampler::deliverCrossings()
+{
+  CrossingVector crossings;
+  pthread_mutex_lock(&mMutex);
+  crossings.swap(mCrossings);
+  pthread_mutex_unlock(&mMutex);
+  for (CrossingVector::iterator pos = crossings.begin(); pos!=crossings.end(); ++pos) {
+    FOCUSLOG("SensorSampler: channel %d average %.3f %s threshold", pos->channel, pos->average, pos->above ? "above" : "below");
+    if (mThresholdCB) mThresholdCB(pos->channel, pos->above, pos->average, pos->when);
+  }
+}
+
+
+void SensorSampler::samplerThreadSignal(ChildThreadWrapper &aChildThread, ThreadSignals aSignalCode)
+{
+  if (aSignalCode==threadSignalUserSignal) {
+    deliverCrossings();
+  }
+  else if (aSignalCode==threadSignalFailedToStart) {
+    LOG(LOG_ERR, "SensorSampler: sampling thread failed to start");
+    mSamplerThread.reset();
+  }
+}
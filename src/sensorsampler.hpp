@@ -0,0 +1,134 @@
+//
+//  Copyright (c) 2026 plan44.ch / Lukas Zeller, Zurich, Switzerland
+//
+//  Author: Lukas Zeller <luz@plan44.ch>
+//
+//  This file is part of p44featured.
+//
+//  p44featured is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  p44featured is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with p44featured. If not, see <http://www.gnu.org/licenses/>.
+//
+
+#ifndef __p44featured__sensorsampler__
+#define __p44featured__sensorsampler__
+
+#include "p44utils_common.hpp"
+#include "analogio.hpp"
+
+#include <pthread.h>
+#include <atomic>
+
+using namespace std;
+
+namespace p44 {
+
+  /// callback for threshold crossings of a sensor channel's moving average
+  /// @param aChannel index of the channel (in order of addChannel() calls)
+  /// @param aAbove true when the average has risen above the threshold, false when it has fallen below threshold-hysteresis
+  /// @param aAverage the moving average at the time of the crossing
+  /// @param aWhen MainLoop::now() timestamp of the sample that caused the crossing
+  typedef boost::function<void (int aChannel, bool aAbove, double aAverage, MLMicroSeconds aWhen)> SensorThresholdCB;
+
+  class SensorSampler;
+  typedef boost::intrusive_ptr<SensorSampler> SensorSamplerPtr;
+
+  /// Samples analog inputs at a fixed rate on a separate thread.
+  /// - samples are taken on absolute clock deadlines, so mainloop load does not cause jitter
+  /// - each channel keeps its moving average window as a ring buffer with a running sum (O(1) per sample)
+  /// - samples are collected in blocks and filtered per block for all channels at once
+  /// - only threshold crossings are passed to the mainloop thread
+  class SensorSampler : public P44Obj
+  {
+    typedef P44Obj inherited;
+
+    struct Channel {
+      AnalogIoPtr sensor; ///< the input
+      vector<double> window; ///< moving average window (ring buffer)
+      size_t pos; ///< next position to write in window
+      size_t filled; ///< number of valid samples in window
+      double sum; ///< running sum of the valid samples in window
+      double threshold; ///< threshold for the moving average
+      double hysteresis; ///< average must fall below threshold-hysteresis to count as below again
+      bool above; ///< current state
+      double lastAverage; ///< most recent average, protected by mMutex (read from mainloop thread)
+    };
+    typedef vector<Channel> ChannelVector;
+
+    struct Crossing {
+      int channel;
+      bool above;
+      double average;
+      MLMicroSeconds when;
+    };
+    typedef vector<Crossing> CrossingVector;
+
+    ChannelVector mChannels;
+    MLMicroSeconds mInterval; ///< sampling interval
+    size_t mBlockSize; ///< number of sample periods collected before filtering
+    vector<double> mBlock; ///< raw samples of current block, channel-interleaved
+    vector<MLMicroSeconds> mBlockTimes; ///< timestamps of the samples in current block
+    SensorThresholdCB mThresholdCB;
+
+    ChildThreadWrapperPtr mSamplerThread;
+    mutable pthread_mutex_t mMutex; ///< protects mCrossings and the channels' lastAverage
+    CrossingVector mCrossings; ///< crossings detected by sampler thread, not yet delivered
+    std::atomic<long> mOverruns; ///< number of sample deadlines missed (written by the sampler thread, read by metrics)
+
+  public:
+
+    /// create sampler
+    /// @param aSampleRate samples per second per channel
+    /// @param aBlockSize number of samples collected per channel before filtering them as a block
+    SensorSampler(double aSampleRate, size_t aBlockSize = 1);
+    virtual ~SensorSampler();
+
+    /// add a channel. Must be called before start()
+    /// @param aSensor the analog input to sample
+    /// @param aMvgAvgCnt number of samples in the moving average
+    /// @param aThreshold threshold for the moving average
+    /// @param aHysteresis hysteresis below aThreshold required to report falling below again
+    /// @return channel index
+    int addChannel(AnalogIoPtr aSensor, size_t aMvgAvgCnt, double aThreshold, double aHysteresis = 0);
+
+    /// start sampling
+    /// @param aThresholdCB called on the mainloop thread for every threshold crossing
+    void start(SensorThresholdCB aThresholdCB);
+
+    /// stop sampling
+    void stop();
+
+    /// @return most recent moving average of a channel
+    double average(int aChannel) const;
+
+    /// process one block of samples the same way the sampler thread does, and deliver crossings right away
+    /// @param aSamples block size * number of channels samples, channel-interleaved
+    /// @param aTimes block size timestamps
+    /// @param aThresholdCB called for every threshold crossing
+    /// @note for feeding samples from other sources and for testing. Must not be used while sampling runs
+    void processSamples(const double *aSamples, const MLMicroSeconds *aTimes, SensorThresholdCB aThresholdCB);
+
+    /// @return number of sample deadlines missed so far
+    long overruns() const { return mOverruns.load(std::memory_order_relaxed); }
+
+  private:
+
+    void samplerThread(ChildThreadWrapper &aThread);
+    void samplerThreadSignal(ChildThreadWrapper &aChildThread, ThreadSignals aSignalCode);
+    bool processBlock();
+    void deliverCrossings();
+
+  };
+
+} // namespace p44
+
+#endif /* defined(__p44featured__sensorsampler__) */
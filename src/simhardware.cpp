@@ -0,0 +1,292 @@
+//
+//  Copyright (c) 2026 plan44.ch / Lukas Zeller, Zurich, Switzerland
+//
+//  Author: Lukas Zeller <luz@plan44.ch>
+//
+//  This file is part of p44featured.
+//
+//  p44featured is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  p44featured is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with p44featured. If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "simhardware.hpp"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <poll.h>
+#include <errno.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#define SERIAL_CONSUME_INTERVAL (5*MilliSecond)
+#define SERIAL_HW_FIFO_SIZE 16 // UART FIFO, max bytes the line can "save up" while idle
+#define SERIAL_SOCKET_RCVBUF 512 // small, so backpressure reaches the sender quickly
+#define LEDCHAIN_RESET_TIME (50*MicroSecond)
+#define LEDCHAIN_PIPE_SIZE 4096
+
+using namespace p44;
+
+
+// MARK: - SimDevice
+
+SimDevice::SimDevice(const string aName) :
+  mName(aName),
+  mStartedAt(Never),
+  mBytes(0),
+  mUnits(0),
+  mBusyTime(0)
+{
+}
+
+
+JsonObjectPtr SimDevice::stats()
+{
+  JsonObjectPtr s = JsonObject::newObj();
+  MLMicroSeconds period = mStartedAt==Never ? 0 : MainLoop::now()-mStartedAt;
+  s->add("bytes", JsonObject::newInt64(mBytes));
+  s->add("busy_us", JsonObject::newInt64(mBusyTime));
+  s->add("utilisation", JsonObject::newDouble(period>0 ? (double)mBusyTime/period : 0));
+  return s;
+}
+
+
+// MARK: - SimSerialDevice
+
+SimSerialDevice::SimSerialDevice(int aPort, int aBaudRate) :
+  inherited(string_format("serial:%d", aPort)),
+  mPort(aPort),
+  mBaudRate(aBaudRate>0 ? aBaudRate : 9600),
+  mListenFd(-1),
+  mConnFd(-1),
+  mByteCredit(0)
+{
+}
+
+
+SimSerialDevice::~SimSerialDevice()
+{
+  stop();
+}
+
+
+ErrorPtr SimSerialDevice::start()
+{
+  mListenFd = socket(AF_INET, SOCK_STREAM, 0);
+  if (mListenFd<0) return SysError::errNo("sim serial socket: ");
+  int one = 1;
+  setsockopt(mListenFd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+  struct sockaddr_in sa;
+  memset(&sa, 0, sizeof(sa));
+  sa.sin_family = AF_INET;
+  sa.sin_port = htons(mPort);
+  sa.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  if (bind(mListenFd, (struct sockaddr *)&sa, sizeof(sa))<0 || listen(mListenFd, 1)<0) {
+    ErrorPtr err = SysError::errNo("sim serial bind/listen: ");
+    close(mListenFd);
+    mListenFd = -1;
+    return err;
+  }
+  fcntl(mListenFd, F_SETFL, fcntl(mListenFd, F_GETFL) | O_NONBLOCK);
+  MainLoop::currentMainLoop().registerPollHandler(mListenFd, POLLIN, boost::bind(&SimSerialDevice::connectionRequest, this, _1, _2));
+  mStartedAt = MainLoop::now();
+  LOG(LOG_NOTICE, "simulated serial device listening on 127.0.0.1:%d at %d baud", mPort, mBaudRate);
+  return ErrorPtr();
+}
+
+
+void SimSerialDevice::stop()
+{
+  mConsumeTicket.cancel();
+  if (mConnFd>=0) {
+    close(mConnFd);
+    mConnFd = -1;
+  }
+  if (mListenFd>=0) {
+    MainLoop::currentMainLoop().unregisterPollHandler(mListenFd);
+    close(mListenFd);
+    mListenFd = -1;
+  }
+}
+
+
+bool SimSerialDevice::connectionRequest(int aFD, int aPollFlags)
+{
+  int fd = accept(mListenFd, NULL, NULL);
+  if (fd<0) return true;
+  if (mConnFd>=0) close(mConnFd); // a serial line has only one end
+  mConnFd = fd;
+  int rcvbuf = SERIAL_SOCKET_RCVBUF;
+  setsockopt(mConnFd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+  fcntl(mConnFd, F_SETFL, fcntl(mConnFd, F_GETFL) | O_NONBLOCK);
+  mByteCredit = 0;
+  LOG(LOG_INFO, "simulated serial device on port %d: connected", mPort);
+  // not reading via poll handler: bytes are only taken off the socket as fast as the line could send them
+  mConsumeTicket.executeOnce(boost::bind(&SimSerialDevice::consume, this), SERIAL_CONSUME_INTERVAL);
+  return true;
+}
+
+
+void SimSerialDevice::consume()
+{
+  if (mConnFd<0) return;
+  // 8N1: 10 bit times per byte
+  mByteCredit += (double)SERIAL_CONSUME_INTERVAL*mBaudRate/10/Second;
+  uint8_t buf[1024];
+  size_t want = (size_t)mByteCredit;
+  if (want>sizeof(buf)) want = sizeof(buf);
+  ssize_t n = want>0 ? read(mConnFd, buf, want) : 0;
+  if (n==0 && want>0) {
+    LOG(LOG_INFO, "simulated serial device on port %d: disconnected", mPort);
+    close(mConnFd);
+    mConnFd = -1;
+    return;
+  }
+  if (n>0) {
+    mByteCredit -= n;
+    mBytes += n;
+    mUnits++;
+    mBusyTime += (MLMicroSeconds)n*10*Second/mBaudRate;
+  }
+  else if (mByteCredit>SERIAL_HW_FIFO_SIZE) {
+    // idle line does not accumulate more than what fits the FIFO
+    mByteCredit = SERIAL_HW_FIFO_SIZE;
+  }
+  mConsumeTicket.executeOnce(boost::bind(&SimSerialDevice::consume, this), SERIAL_CONSUME_INTERVAL);
+}
+
+
+JsonObjectPtr SimSerialDevice::stats()
+{
+  JsonObjectPtr s = inherited::stats();
+  s->add("baudrate", JsonObject::newInt32(mBaudRate));
+  s->add("reads", JsonObject::newInt64(mUnits));
+  s->add("connected", JsonObject::newBool(mConnFd>=0));
+  return s;
+}
+
+
+// MARK: - SimLedChainDevice
+
+SimLedChainDevice::SimLedChainDevice(const string aFifoPath, int aNumLeds, MLMicroSeconds aLedTime, int aBytesPerLed) :
+  inherited("ledchain:"+aFifoPath),
+  mFifoPath(aFifoPath),
+  mNumLeds(aNumLeds>0 ? aNumLeds : 1),
+  mBytesPerLed(aBytesPerLed),
+  mLedTime(aLedTime),
+  mFd(-1),
+  mThreadRunning(false),
+  mStop(false)
+{
+  pthread_mutex_init(&mStatsMutex, NULL);
+}
+
+
+SimLedChainDevice::~SimLedChainDevice()
+{
+  stop();
+  pthread_mutex_destroy(&mStatsMutex);
+}
+
+
+ErrorPtr SimLedChainDevice::start()
+{
+  struct stat st;
+  if (stat(mFifoPath.c_str(), &st)!=0) {
+    if (mkfifo(mFifoPath.c_str(), 0666)!=0) return SysError::errNo("cannot create simulated ledchain fifo: ");
+  }
+  else if (!S_ISFIFO(st.st_mode)) {
+    return TextError::err("'%s' exists and is not a FIFO", mFifoPath.c_str());
+  }
+  // open read end non-blocking first, so the ledchain can open the write end without blocking
+  mFd = open(mFifoPath.c_str(), O_RDONLY|O_NONBLOCK);
+  if (mFd<0) return SysError::errNo("cannot open simulated ledchain fifo: ");
+  #ifdef F_SETPIPE_SZ
+  // small pipe, so the writer experiences backpressure after a few frames like with a real chain
+  fcntl(mFd, F_SETPIPE_SZ, LEDCHAIN_PIPE_SIZE);
+  #endif
+  mStartedAt = MainLoop::now();
+  mStop.store(false);
+  if (pthread_create(&mReaderThread, NULL, &SimLedChainDevice::readerThread, this)!=0) {
+    close(mFd);
+    mFd = -1;
+    return TextError::err("cannot start simulated ledchain reader thread");
+  }
+  mThreadRunning = true;
+  LOG(LOG_NOTICE, "simulated ledchain '%s': %d LEDs, %lld uS per frame", mFifoPath.c_str(), mNumLeds, (long long)(mNumLeds*mLedTime+LEDCHAIN_RESET_TIME));
+  return ErrorPtr();
+}
+
+
+void SimLedChainDevice::stop()
+{
+  if (mThreadRunning) {
+    mStop.store(true);
+    pthread_join(mReaderThread, NULL);
+    mThreadRunning = false;
+  }
+  if (mFd>=0) {
+    close(mFd);
+    mFd = -1;
+  }
+}
+
+
+void *SimLedChainDevice::readerThread(void *aArg)
+{
+  static_cast<SimLedChainDevice *>(aArg)->reader();
+  return NULL;
+}
+
+
+void SimLedChainDevice::reader()
+{
+  MLMicroSeconds frameTime = mNumLeds*mLedTime+LEDCHAIN_RESET_TIME;
+  size_t frameBytes = mNumLeds*mBytesPerLed;
+  vector<uint8_t> buf(frameBytes);
+  size_t frameFill = 0; // bytes of the current frame received so far (frames can be larger than the pipe)
+  while (!mStop.load()) {
+    ssize_t n = read(mFd, &buf[0], frameBytes);
+    if (n>0) {
+      // transmitting keeps the chain busy in proportion to the data
+      MLMicroSeconds busy = (MLMicroSeconds)n*frameTime/frameBytes;
+      pthread_mutex_lock(&mStatsMutex);
+      mBytes += n;
+      mBusyTime += busy;
+      frameFill += n;
+      while (frameFill>=frameBytes) {
+        frameFill -= frameBytes;
+        mUnits++;
+      }
+      pthread_mutex_unlock(&mStatsMutex);
+      MainLoop::sleep(busy);
+      continue;
+    }
+    // idle, check again soon
+    MainLoop::sleep(frameTime/4+1);
+  }
+}
+
+
+JsonObjectPtr SimLedChainDevice::stats()
+{
+  pthread_mutex_lock(&mStatsMutex);
+  JsonObjectPtr s = inherited::stats();
+  MLMicroSeconds period = mStartedAt==Never ? 0 : MainLoop::now()-mStartedAt;
+  s->add("leds", JsonObject::newInt32(mNumLeds));
+  s->add("frames", JsonObject::newInt64(mUnits));
+  s->add("fps", JsonObject::newDouble(period>0 ? (double)mUnits*Second/period : 0));
+  pthread_mutex_unlock(&mStatsMutex);
+  return s;
+}
@@ -0,0 +1,144 @@
+//
+//  Copyright (c) 2026 plan44.ch / Lukas Zeller, Zurich, Switzerland
+//
+//  Author: Lukas Zeller <luz@plan44.ch>
+//
+//  This file is part of p44featured.
+//
+//  p44featured is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  p44featured is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with p44featured. If not, see <http://www.gnu.org/licenses/>.
+//
+
+#ifndef __p44featured__simhardware__
+#define __p44featured__simhardware__
+
+#include "p44utils_common.hpp"
+#include "jsonobject.hpp"
+
+#include <atomic>
+#include <pthread.h>
+
+using namespace std;
+
+namespace p44 {
+
+  class SimDevice;
+  typedef boost::intrusive_ptr<SimDevice> SimDevicePtr;
+
+  /// Base class for simulated hardware endpoints.
+  /// Simulated devices consume the data the features send at the rate the real hardware would,
+  /// so the features see the same backpressure and the daemon the same load as in production.
+  class SimDevice : public P44Obj
+  {
+  protected:
+
+    string mName;
+    MLMicroSeconds mStartedAt;
+    uint64_t mBytes; ///< bytes consumed
+    uint64_t mUnits; ///< frames/transfers consumed
+    MLMicroSeconds mBusyTime; ///< simulated time the device was busy transmitting
+
+    SimDevice(const string aName);
+
+  public:
+
+    virtual ~SimDevice() {};
+
+    /// start simulation
+    virtual ErrorPtr start() = 0;
+
+    /// stop simulation
+    virtual void stop() = 0;
+
+    /// @return statistics
+    virtual JsonObjectPtr stats();
+
+    /// @return name
+    const string &name() const { return mName; }
+
+  };
+
+
+  /// Simulated serial device: accepts a TCP connection (for serial specs in IP:port form)
+  /// and consumes the received bytes no faster than the baud rate allows.
+  class SimSerialDevice : public SimDevice
+  {
+    typedef SimDevice inherited;
+
+    int mPort;
+    int mBaudRate;
+    int mListenFd;
+    int mConnFd;
+    MLTicket mConsumeTicket;
+    double mByteCredit; ///< bytes the simulated line could have sent since the last read
+
+  public:
+
+    /// @param aPort TCP port to listen on (localhost only)
+    /// @param aBaudRate simulated line speed (8N1, 10 bits per byte)
+    SimSerialDevice(int aPort, int aBaudRate);
+    virtual ~SimSerialDevice();
+
+    virtual ErrorPtr start() P44_OVERRIDE;
+    virtual void stop() P44_OVERRIDE;
+    virtual JsonObjectPtr stats() P44_OVERRIDE;
+
+  private:
+
+    bool connectionRequest(int aFD, int aPollFlags);
+    void consume();
+
+  };
+
+
+  /// Simulated LED chain: a FIFO that can be used as a ledchain device path,
+  /// read one frame per refresh time of a WS281x type chain.
+  /// The FIFO is read on a separate thread, because the ledchain writes to it from the mainloop
+  /// and blocks when the pipe is full.
+  class SimLedChainDevice : public SimDevice
+  {
+    typedef SimDevice inherited;
+
+    string mFifoPath;
+    int mNumLeds;
+    int mBytesPerLed;
+    MLMicroSeconds mLedTime; ///< transmission time per LED
+    int mFd;
+    pthread_t mReaderThread;
+    bool mThreadRunning;
+    std::atomic<bool> mStop;
+    pthread_mutex_t mStatsMutex; ///< protects the inherited counters, updated by the reader thread
+
+  public:
+
+    /// @param aFifoPath path for the FIFO, will be created if needed
+    /// @param aNumLeds number of LEDs in the chain
+    /// @param aLedTime transmission time per LED (WS2812: 24 bits * 1.25uS = 30uS)
+    /// @param aBytesPerLed 3 for RGB, 4 for RGBW chains
+    SimLedChainDevice(const string aFifoPath, int aNumLeds, MLMicroSeconds aLedTime = 30*MicroSecond, int aBytesPerLed = 3);
+    virtual ~SimLedChainDevice();
+
+    virtual ErrorPtr start() P44_OVERRIDE;
+    virtual void stop() P44_OVERRIDE;
+    virtual JsonObjectPtr stats() P44_OVERRIDE;
+
+  private:
+
+    static void *readerThread(void *aArg);
+    void reader();
+
+  };
+
+} // namespace p44
+
+#endif /* defined(__p44featured__simhardware__) */
@@ -0,0 +1,85 @@
+//
+//  Copyright (c) 2026 plan44.ch / Lukas Zeller, Zurich, Switzerland
+//
+//  Author: Lukas Zeller <luz@plan44.ch>
+//
+//  This file is part of p44featured.
+//
+//  p44featured is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  p44featured is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with p44featured. If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "statesnapshot.hpp"
+#include "binjson.hpp"
+
+using namespace p44;
+
+
+StateSnapshot::StateSnapshot(const string aPath) :
+  mPath(aPath),
+  mFeatureInits(JsonObject::newObj())
+{
+}
+
+
+void StateSnapshot::recordInit(const string aFeatureName, JsonObjectPtr aInitRequest)
+{
+  if (!aInitRequest) return;
+  mFeatureInits->add(aFeatureName.c_str(), aInitRequest);
+}
+
+
+ErrorPtr StateSnapshot::save(JsonObjectPtr aViewStatus, JsonObjectPtr aVars)
+{
+  JsonObjectPtr snapshot = JsonObject::newObj();
+  if (aViewStatus) snapshot->add("view", aViewStatus);
+  snapshot->add("features", mFeatureInits);
+  if (aVars) snapshot->add("vars", aVars);
+  return BinJson::saveFile(mPath, snapshot);
+}
+
+
+ErrorPtr StateSnapshot::load()
+{
+  mRestored.reset();
+  JsonObjectPtr snapshot;
+  ErrorPtr err = BinJson::loadFile(mPath, snapshot);
+  if (Error::notOK(err)) return err;
+  if (!snapshot || !snapshot->isType(json_type_object)) {
+    return TextError::err("snapshot '%s' has no valid state", mPath.c_str());
+  }
+  mRestored = snapshot;
+  return ErrorPtr();
+}
+
+
+void StateSnapshot::apply(FeatureCB aFeatureCB, ViewCB aViewCB, VarCB aVarCB)
+{
+  JsonObjectPtr restored = mRestored;
+  mRestored.reset();
+  if (!restored) return;
+  JsonObjectPtr o;
+  string name;
+  JsonObjectPtr val;
+  if (aFeatureCB && restored->get("features", o)) {
+    o->resetKeyIteration();
+    while (o->nextKeyValue(name, val)) aFeatureCB(name, val);
+  }
+  if (aViewCB && restored->get("view", o)) {
+    aViewCB(o);
+  }
+  if (aVarCB && restored->get("vars", o)) {
+    o->resetKeyIteration();
+    while (o->nextKeyValue(name, val)) aVarCB(name, val);
+  }
+}
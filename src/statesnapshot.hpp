@@ -0,0 +1,86 @@
+//
+//  Copyright (c) 2026 plan44.ch / Lukas Zeller, Zurich, Switzerland
+//
+//  Author: Lukas Zeller <luz@plan44.ch>
+//
+//  This file is part of p44featured.
+//
+//  p44featured is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  p44featured is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with p44featured. If not, see <http://www.gnu.org/licenses/>.
+//
+
+#ifndef __p44featured__statesnapshot__
+#define __p44featured__statesnapshot__
+
+#include "p44utils_common.hpp"
+#include "jsonobject.hpp"
+
+using namespace std;
+
+namespace p44 {
+
+  class StateSnapshot;
+  typedef boost::intrusive_ptr<StateSnapshot> StateSnapshotPtr;
+
+  /// Runtime state saved at exit and re-applied at the next start.
+  /// The state consists of the view tree status, the latest accepted "init" request per feature,
+  /// and selected script variables. It is stored as a BinJson file.
+  class StateSnapshot : public P44Obj
+  {
+  public:
+
+    typedef boost::function<void (JsonObjectPtr aViewStatus)> ViewCB;
+    typedef boost::function<void (const string aFeatureName, JsonObjectPtr aInitRequest)> FeatureCB;
+    typedef boost::function<void (const string aVarName, JsonObjectPtr aValue)> VarCB;
+
+  private:
+
+    string mPath;
+    JsonObjectPtr mFeatureInits; ///< latest init request per feature
+    JsonObjectPtr mRestored; ///< loaded state, until applied
+
+  public:
+
+    /// @param aPath path of the snapshot file
+    StateSnapshot(const string aPath);
+
+    /// remember an init request a feature has accepted
+    /// @param aFeatureName the feature
+    /// @param aInitRequest the request, kept as-is (pass a copy if the request object is modified later)
+    void recordInit(const string aFeatureName, JsonObjectPtr aInitRequest);
+
+    /// save the state
+    /// @param aViewStatus status of the root view, NULL if none
+    /// @param aVars script variables by name, NULL if none
+    ErrorPtr save(JsonObjectPtr aViewStatus, JsonObjectPtr aVars);
+
+    /// load the state saved before
+    /// @return error if there is no valid snapshot
+    ErrorPtr load();
+
+    /// @return true if a state was loaded and is not yet applied
+    bool restorePending() const { return mRestored!=NULL; }
+
+    /// re-apply the loaded state, in a fixed order: all feature inits first, then the view
+    /// (which shows the state the features' views had), then the script variables.
+    /// The loaded state is forgotten afterwards.
+    /// @param aFeatureCB called for every feature with its init request
+    /// @param aViewCB called with the view status, if any
+    /// @param aVarCB called for every script variable
+    void apply(FeatureCB aFeatureCB, ViewCB aViewCB, VarCB aVarCB);
+
+  };
+
+} // namespace p44
+
+#endif /* defined(__p44featured__statesnapshot__) */
@@ -0,0 +1,392 @@
+//
+//  Copyright (c) 2026 plan44.ch / Lukas Zeller, Zurich, Switzerland
+//
+//  Author: Lukas Zeller <luz@plan44.ch>
+//
+//  This file is part of p44featured.
+//
+//  p44featured is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  p44featured is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with p44featured. If not, see <http://www.gnu.org/licenses/>.
+//
+
+// Benchmark suite for the p44featured hot paths.
+// Usage: p44featured_bench [-o resultfile] [-n iterations] [-r featureapi_request_json] [-v viewconfig_jsonfile] [-p jsonapiport] [p44featured options...]
+// Results are written as JSON, so runs from different releases can be compared with standard tools.
+
+#define P44FEATURED_NO_MAIN 1
+#include "p44featured_main.cpp"
+
+#include <sys/utsname.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <poll.h>
+
+#define DEFAULT_BENCH_ITERATIONS 10000
+#define DEFAULT_BENCH_FEATUREREQUEST "{ \"feature\":\"light\", \"cmd\":\"status\" }"
+#define DEFAULT_BENCH_SCRIPT "var a = 1; a = a*2+3; a"
+#define DEFAULT_BENCH_APIPORT "18099" // local port for the mg44 style JSON API round trip benchmark
+#define BENCH_RENDER_FRAMES 500
+
+// reference LED arrangement: 64x32 pixels, a light spot background, text and a torch
+#define DEFAULT_BENCH_VIEWCONFIG \
+  "{ \"type\":\"stack\", \"label\":\"bench\", \"x\":0, \"y\":0, \"dx\":64, \"dy\":32, \"layers\":[" \
+    "{ \"view\":{ \"type\":\"lightspot\", \"x\":0, \"y\":0, \"dx\":64, \"dy\":32, \"color\":\"FF8000\", \"extent_x\":20, \"extent_y\":10 } }," \
+    "{ \"view\":{ \"type\":\"text\", \"x\":0, \"y\":8, \"dx\":64, \"dy\":8, \"text\":\"p44featured\", \"color\":\"00FF00\" } }," \
+    "{ \"view\":{ \"type\":\"torch\", \"x\":0, \"y\":24, \"dx\":64, \"dy\":8 } }" \
+  "] }"
+
+static const long timerBenchCounts[] = { 10, 100, 1000, 10000, 0 };
+
+
+class P44FeatureDBench : public P44FeatureD
+{
+  typedef P44FeatureD inherited;
+
+  JsonObjectPtr mResults;
+  long mIterations;
+  string mResultFile;
+  string mFeatureRequest;
+  string mViewConfigFile;
+  string mApiPort;
+  string mApiRequestText;
+  MLMicroSeconds mApiBenchStart;
+  long mCompleted;
+  size_t mAllocsAtStart; ///< allocation count when the current benchmark started
+  CallbackSlots<JsonObjectPtr> mSlots;
+
+  int mTimerBenchIndex;
+  long mTimersPending;
+  MLMicroSeconds mTimerBenchStart;
+
+public:
+
+  P44FeatureDBench() :
+    mIterations(DEFAULT_BENCH_ITERATIONS),
+    mFeatureRequest(DEFAULT_BENCH_FEATUREREQUEST),
+    mApiPort(DEFAULT_BENCH_APIPORT),
+    mApiBenchStart(Never),
+    mCompleted(0),
+    mAllocsAtStart(0),
+    mTimerBenchIndex(0),
+    mTimersPending(0),
+    mTimerBenchStart(Never)
+  {
+    mResults = JsonObject::newArray();
+  }
+
+
+  int benchMain(int argc, char **argv)
+  {
+    // extract bench specific arguments, pass the rest to the daemon
+    vector<char *> args;
+    args.push_back(argv[0]);
+    for (int i=1; i<argc; i++) {
+      if (strcmp(argv[i], "-o")==0 && i+1<argc) mResultFile = argv[++i];
+      else if (strcmp(argv[i], "-n")==0 && i+1<argc) mIterations = atol(argv[++i]);
+      else if (strcmp(argv[i], "-r")==0 && i+1<argc) mFeatureRequest = argv[++i];
+      else if (strcmp(argv[i], "-v")==0 && i+1<argc) mViewConfigFile = argv[++i];
+      else if (strcmp(argv[i], "-p")==0 && i+1<argc) mApiPort = argv[++i];
+      else args.push_back(argv[i]);
+    }
+    if (mIterations<1) mIterations = 1;
+    // JSON API server for the round trip benchmark (local connections only)
+    static char apiportOpt[] = "--jsonapiport";
+    args.push_back(apiportOpt);
+    args.push_back(&mApiPort[0]);
+    // daemon needs at least one option to run
+    static char loglevelOpt[] = "--loglevel";
+    static char loglevelVal[] = "3";
+    args.push_back(loglevelOpt);
+    args.push_back(loglevelVal);
+    args.push_back(NULL);
+    return main((int)args.size()-1, &args[0]);
+  }
+
+
+  virtual void startupComplete() P44_OVERRIDE
+  {
+    // features exist now
+    inherited::startupComplete();
+    MainLoop::currentMainLoop().executeNow(boost::bind(&P44FeatureDBench::startApiBench, this));
+  }
+
+
+  MLMicroSeconds startBench()
+  {
+    mAllocsAtStart = AllocStats::allocations();
+    return MainLoop::now();
+  }
+
+
+  void addResult(const string aName, long aIterations, MLMicroSeconds aDuration, JsonObjectPtr aExtra = JsonObjectPtr())
+  {
+    size_t allocs = AllocStats::allocations()-mAllocsAtStart;
+    JsonObjectPtr r = aExtra ? aExtra : JsonObject::newObj();
+    r->add("name", JsonObject::newString(aName));
+    r->add("iterations", JsonObject::newInt64(aIterations));
+    r->add("total_us", JsonObject::newInt64(aDuration));
+    r->add("per_op_ns", JsonObject::newDouble(aIterations>0 ? (double)aDuration*1000/aIterations : 0));
+    r->add("ops_per_s", JsonObject::newDouble(aDuration>0 ? (double)aIterations*Second/aDuration : 0));
+    // allocations are only known when counting is compiled in (--enable-allocstats)
+    if (AllocStats::enabled()) {
+      r->add("allocs_per_op", JsonObject::newDouble(aIterations>0 ? (double)allocs/aIterations : 0));
+    }
+    else {
+      r->add("allocs_per_op", JsonObjectPtr()); // null = not measured
+    }
+    mResults->arrayAppend(r);
+    if (AllocStats::enabled()) {
+      fprintf(stderr, "%-28s %10ld ops %12.0f ns/op %8.1f allocs/op\n", aName.c_str(), aIterations, aIterations>0 ? (double)aDuration*1000/aIterations : 0.0, aIterations>0 ? (double)allocs/aIterations : 0.0);
+    }
+    else {
+      fprintf(stderr, "%-28s %10ld ops %12.0f ns/op      n/a allocs/op\n", aName.c_str(), aIterations, aIterations>0 ? (double)aDuration*1000/aIterations : 0.0);
+    }
+  }
+
+
+  void countCompletion(JsonObjectPtr aResponse, ErrorPtr aError)
+  {
+    // serialize like a real response would be
+    if (aResponse) aResponse->json_c_str();
+    mCompleted++;
+  }
+
+
+  void countScriptCompletion(JsonObjectPtr aResponse, ErrorPtr aError)
+  {
+    countCompletion(aResponse, aError);
+  }
+
+
+  void slotCompletion(int aSlot, JsonObjectPtr aResponse, ErrorPtr aError)
+  {
+    mSlots.take(aSlot);
+    countCompletion(aResponse, aError);
+  }
+
+
+  void contextCompletion(JsonObjectPtr aContext, JsonObjectPtr aResponse, ErrorPtr aError)
+  {
+    countCompletion(aResponse, aError);
+  }
+
+
+  JsonObjectPtr completionInfo()
+  {
+    JsonObjectPtr x = JsonObject::newObj();
+    x->add("completed", JsonObject::newInt64(mCompleted));
+    return x;
+  }
+
+
+  // MARK: - mg44 style API round trip
+
+  /// Sends the requests over TCP to the JSON API server, like mg44 does, one connection per request.
+  /// This covers the whole path: accept, apiConnectionHandler(), JSON parsing from the wire,
+  /// apiRequestHandler(), dispatch, requestHandled() and the response serialisation.
+  void startApiBench()
+  {
+    mApiRequestText = string_format("{ \"method\":\"POST\", \"uri\":\"featureapi\", \"data\":%s }", mFeatureRequest.c_str());
+    mCompleted = 0;
+    mApiBenchStart = startBench();
+    nextApiRequest();
+  }
+
+
+  void nextApiRequest()
+  {
+    if (mCompleted>=mIterations) {
+      addResult("api_parse_dispatch", mCompleted, MainLoop::now()-mApiBenchStart, completionInfo());
+      runBenchmarks();
+      return;
+    }
+    struct sockaddr_in sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sin_family = AF_INET;
+    sa.sin_port = htons(atoi(mApiPort.c_str()));
+    sa.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (
+      fd<0 ||
+      connect(fd, (struct sockaddr *)&sa, sizeof(sa))<0 ||
+      write(fd, mApiRequestText.c_str(), mApiRequestText.size())!=(ssize_t)mApiRequestText.size()
+    ) {
+      fprintf(stderr, "api round trip benchmark skipped: %s\n", strerror(errno));
+      if (fd>=0) close(fd);
+      runBenchmarks();
+      return;
+    }
+    MainLoop::currentMainLoop().registerPollHandler(fd, POLLIN, boost::bind(&P44FeatureDBench::apiResponseReady, this, _1, _2));
+  }
+
+
+  bool apiResponseReady(int aFD, int aPollFlags)
+  {
+    char buf[1024];
+    if (read(aFD, buf, sizeof(buf))>0) return true; // more to come, server closes the connection after the response
+    MainLoop::currentMainLoop().unregisterPollHandler(aFD);
+    close(aFD);
+    mCompleted++;
+    MainLoop::currentMainLoop().executeNow(boost::bind(&P44FeatureDBench::nextApiRequest, this));
+    return true;
+  }
+
+
+  // MARK: - synchronous benchmarks
+
+  void runBenchmarks()
+  {
+    // feature API dispatch only, pre-parsed request
+    JsonObjectPtr featureReq = JsonObject::objFromText(mFeatureRequest.c_str());
+    mCompleted = 0;
+    MLMicroSeconds start = startBench();
+    for (long i=0; i<mIterations; i++) {
+      dispatchFeatureRequest(featureReq, boost::bind(&P44FeatureDBench::countCompletion, this, _1, _2));
+    }
+    addResult("featureapi_dispatch", mIterations, MainLoop::now()-start, completionInfo());
+    // request callback creation and invocation: context bound by boost::bind vs. inline delegate with slot
+    JsonObjectPtr ctx = JsonObject::newObj();
+    mCompleted = 0;
+    start = startBench();
+    for (long i=0; i<mIterations; i++) {
+      RequestDoneCB cb = boost::bind(&P44FeatureDBench::contextCompletion, this, ctx, _1, _2);
+      cb(JsonObjectPtr(), ErrorPtr());
+    }
+    addResult("delegate_bind", mIterations, MainLoop::now()-start, completionInfo());
+    mCompleted = 0;
+    start = startBench();
+    for (long i=0; i<mIterations; i++) {
+      int slot = mSlots.put(ctx);
+      RequestDoneCB cb = inlineCB([this, slot](JsonObjectPtr aResponse, ErrorPtr aError) { slotCompletion(slot, aResponse, aError); });
+      cb(JsonObjectPtr(), ErrorPtr());
+    }
+    addResult("delegate_inline", mIterations, MainLoop::now()-start, completionInfo());
+    #if ENABLE_P44SCRIPT
+    // p44script execcode
+    JsonObjectPtr execReq = JsonObject::newObj();
+    execReq->add("execcode", JsonObject::newString(DEFAULT_BENCH_SCRIPT));
+    mCompleted = 0;
+    start = startBench();
+    for (long i=0; i<mIterations; i++) {
+      processRequest("mainscript", execReq, true, boost::bind(&P44FeatureDBench::countScriptCompletion, this, _1, _2));
+    }
+    addResult("script_execcode", mIterations, MainLoop::now()-start, completionInfo());
+    #endif
+    #if ENABLE_LEDARRANGEMENT
+    benchRender();
+    #endif
+    // asynchronous ones
+    mTimerBenchIndex = 0;
+    startTimerBench();
+  }
+
+
+  #if ENABLE_LEDARRANGEMENT
+
+  void benchRender()
+  {
+    // render the view tree into a memory frame buffer, the same way the LED chain arrangement does per frame
+    ErrorPtr err;
+    JsonObjectPtr cfg;
+    if (!mViewConfigFile.empty()) cfg = JsonObject::objFromFile(mViewConfigFile.c_str(), &err);
+    else cfg = JsonObject::objFromText(DEFAULT_BENCH_VIEWCONFIG, -1, &err);
+    P44ViewPtr root;
+    if (Error::isOK(err)) err = createViewFromConfig(cfg, root, P44ViewPtr());
+    if (Error::notOK(err) || !root) {
+      fprintf(stderr, "render benchmark skipped: %s\n", Error::notOK(err) ? err->text() : "no view");
+      return;
+    }
+    PixelRect f = root->getFrame();
+    vector<PixelColor> frameBuffer(f.dx*f.dy);
+    MLMicroSeconds start = startBench();
+    for (long frame=0; frame<BENCH_RENDER_FRAMES; frame++) {
+      root->step(Infinite);
+      PixelPoint p;
+      size_t i = 0;
+      for (p.y=0; p.y<f.dy; p.y++) {
+        for (p.x=0; p.x<f.dx; p.x++) {
+          frameBuffer[i++] = root->colorAt(p);
+        }
+      }
+    }
+    JsonObjectPtr x = JsonObject::newObj();
+    x->add("pixels", JsonObject::newInt64(f.dx*f.dy));
+    addResult("render_frame", BENCH_RENDER_FRAMES, MainLoop::now()-start, x);
+  }
+
+  #endif // ENABLE_LEDARRANGEMENT
+
+
+  // MARK: - mainloop timer scaling
+
+  void startTimerBench()
+  {
+    long n = timerBenchCounts[mTimerBenchIndex];
+    if (n==0) {
+      finish();
+      return;
+    }
+    mTimersPending = n;
+    mTimerBenchStart = startBench();
+    for (long i=0; i<n; i++) {
+      MainLoop::currentMainLoop().executeOnce(boost::bind(&P44FeatureDBench::timerFired, this), 0);
+    }
+  }
+
+
+  void timerFired()
+  {
+    if (--mTimersPending>0) return;
+    long n = timerBenchCounts[mTimerBenchIndex];
+    addResult(string_format("mainloop_timers_%ld", n), n, MainLoop::now()-mTimerBenchStart);
+    mTimerBenchIndex++;
+    MainLoop::currentMainLoop().executeNow(boost::bind(&P44FeatureDBench::startTimerBench, this));
+  }
+
+
+  // MARK: - results
+
+  void finish()
+  {
+    JsonObjectPtr res = JsonObject::newObj();
+    res->add("version", JsonObject::newString(version()));
+    struct utsname u;
+    if (uname(&u)==0) res->add("machine", JsonObject::newString(u.machine));
+    res->add("unixtime", JsonObject::newInt64(MainLoop::unixtime()/Second));
+    res->add("results", mResults);
+    string out = res->json_str();
+    if (mResultFile.empty()) {
+      printf("%s\n", out.c_str());
+    }
+    else {
+      ErrorPtr err = string_tofile(mResultFile, out);
+      if (Error::notOK(err)) {
+        fprintf(stderr, "cannot write results: %s\n", err->text());
+        terminateApp(EXIT_FAILURE);
+        return;
+      }
+    }
+    terminateApp(EXIT_SUCCESS);
+  }
+
+};
+
+
+int main(int argc, char **argv)
+{
+  SETLOGLEVEL(LOG_EMERG);
+  SETERRLEVEL(LOG_EMERG, false);
+  static P44FeatureDBench application;
+  return application.benchMain(argc, argv);
+}
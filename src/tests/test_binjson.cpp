@@ -0,0 +1,123 @@
+//
+//  Copyright (c) 2026 plan44.ch / Lukas Zeller, Zurich, Switzerland
+//
+//  Author: Lukas Zeller <luz@plan44.ch>
+//
+//  This file is part of p44featured.
+//
+//  p44featured is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  p44featured is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with p44featured. If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "catch.hpp"
+
+#include "binjson.hpp"
+
+#include <unistd.h>
+
+using namespace p44;
+
+static JsonObjectPtr roundTrip(JsonObjectPtr aJson)
+{
+  string bin;
+  BinJson::encode(aJson, bin);
+  JsonObjectPtr decoded;
+  REQUIRE(Error::isOK(BinJson::decode((const uint8_t *)bin.data(), bin.size(), decoded)));
+  return decoded;
+}
+
+
+static JsonObjectPtr sampleTree()
+{
+  JsonObjectPtr o = JsonObject::newObj();
+  o->add("null", JsonObjectPtr());
+  o->add("yes", JsonObject::newBool(true));
+  o->add("no", JsonObject::newBool(false));
+  o->add("small", JsonObject::newInt64(-3));
+  o->add("big", JsonObject::newInt64(-9007199254740993LL));
+  o->add("pi", JsonObject::newDouble(3.14159));
+  o->add("text", JsonObject::newString("hello \"world\" äöü"));
+  o->add("empty", JsonObject::newString(""));
+  JsonObjectPtr a = JsonObject::newArray();
+  a->arrayAppend(JsonObject::newInt64(1));
+  a->arrayAppend(JsonObject::newArray());
+  a->arrayAppend(JsonObject::newObj());
+  o->add("list", a);
+  return o;
+}
+
+
+TEST_CASE("BinJson round trip of all value types", "[binjson]")
+{
+  JsonObjectPtr o = sampleTree();
+  REQUIRE(roundTrip(o)->json_str() == o->json_str());
+  // scalars at top level
+  REQUIRE(roundTrip(JsonObject::newInt64(0))->int64Value() == 0);
+  REQUIRE(roundTrip(JsonObject::newDouble(-0.5))->doubleValue() == -0.5);
+  REQUIRE_FALSE(roundTrip(JsonObjectPtr()));
+}
+
+
+TEST_CASE("BinJson byte order is defined", "[binjson]")
+{
+  string bin;
+  BinJson::encode(JsonObject::newDouble(1.0), bin);
+  // tag followed by IEEE 754 binary64 in little endian order
+  REQUIRE(bin.size() == 9);
+  const uint8_t expected[8] = { 0, 0, 0, 0, 0, 0, 0xF0, 0x3F };
+  REQUIRE(memcmp(bin.data()+1, expected, 8) == 0);
+  bin.clear();
+  BinJson::encode(JsonObject::newInt64(300), bin);
+  // zigzag 600 = 0x258 as varint: 0xD8 0x04
+  REQUIRE(bin.size() == 3);
+  REQUIRE((uint8_t)bin[1] == 0xD8);
+  REQUIRE((uint8_t)bin[2] == 0x04);
+}
+
+
+TEST_CASE("BinJson rejects corrupt data", "[binjson]")
+{
+  string bin;
+  BinJson::encode(sampleTree(), bin);
+  JsonObjectPtr decoded;
+  // every truncation must be detected, never read beyond the data
+  for (size_t len=0; len<bin.size(); len++) {
+    REQUIRE(Error::notOK(BinJson::decode((const uint8_t *)bin.data(), len, decoded)));
+  }
+  // trailing garbage
+  string longer = bin+"x";
+  REQUIRE(Error::notOK(BinJson::decode((const uint8_t *)longer.data(), longer.size(), decoded)));
+  // unknown tag
+  const uint8_t bad[1] = { 0x7F };
+  REQUIRE(Error::notOK(BinJson::decode(bad, 1, decoded)));
+}
+
+
+TEST_CASE("BinJson files with key", "[binjson]")
+{
+  char path[] = "/tmp/binjson_test_XXXXXX";
+  int fd = mkstemp(path);
+  REQUIRE(fd>=0);
+  close(fd);
+  JsonObjectPtr o = sampleTree();
+  REQUIRE(Error::isOK(BinJson::saveFile(path, o, "key1")));
+  JsonObjectPtr loaded;
+  REQUIRE(Error::isOK(BinJson::loadFile(path, loaded, "key1")));
+  REQUIRE(loaded->json_str() == o->json_str());
+  REQUIRE(Error::isOK(BinJson::loadFile(path, loaded))); // no key check
+  REQUIRE(Error::notOK(BinJson::loadFile(path, loaded, "key2")));
+  // not a binary JSON file
+  string_tofile(path, "{\"a\":1}");
+  REQUIRE(Error::notOK(BinJson::loadFile(path, loaded)));
+  unlink(path);
+}
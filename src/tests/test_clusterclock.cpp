@@ -0,0 +1,131 @@
+//
+//  Copyright (c) 2026 plan44.ch / Lukas Zeller, Zurich, Switzerland
+//
+//  Author: Lukas Zeller <luz@plan44.ch>
+//
+//  This file is part of p44featured.
+//
+//  p44featured is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  p44featured is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with p44featured. If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "catch.hpp"
+
+#include "clusterclock.hpp"
+
+#define FRAME (20*MilliSecond)
+
+using namespace p44;
+
+class ClusterClockFixture
+{
+public:
+  ClusterClockPtr clock;
+  int changes;
+
+  ClusterClockFixture() : clock(new ClusterClock(false, "239.255.44.1", 4401, FRAME)), changes(0)
+  {
+    clock->setChangeHandler(boost::bind(&ClusterClockFixture::changed, this));
+  }
+
+  void changed() { changes++; }
+
+  /// feed a beacon as if received at aReceivedAt
+  bool beacon(MLMicroSeconds aMasterTime, MLMicroSeconds aReceivedAt, MLMicroSeconds aEpoch = 1000*Second, MLMicroSeconds aFrameInterval = FRAME)
+  {
+    string b = ClusterClock::beacon(1, aMasterTime, aEpoch, aFrameInterval);
+    return clock->processBeacon(b.data(), b.size(), aReceivedAt);
+  }
+};
+
+
+TEST_CASE_METHOD(ClusterClockFixture, "follower is not synchronized without beacons", "[clusterclock]")
+{
+  REQUIRE_FALSE(clock->synchronized());
+  // runs on local time
+  MLMicroSeconds now = MainLoop::now();
+  REQUIRE(clock->clusterTime(now) == now);
+}
+
+
+TEST_CASE_METHOD(ClusterClockFixture, "beacon sets offset and frame timing", "[clusterclock]")
+{
+  MLMicroSeconds now = MainLoop::now();
+  MLMicroSeconds master = now+5000*Second;
+  REQUIRE(beacon(master, now));
+  REQUIRE(clock->synchronized());
+  REQUIRE(changes == 1);
+  REQUIRE(clock->clusterTime(now) == master);
+  REQUIRE(clock->localTime(master) == now);
+  // frames count from the master's epoch
+  int64_t f = clock->frameAt(now);
+  REQUIRE(f == (master-1000*Second)/FRAME);
+  REQUIRE(clock->clusterTimeOfFrame(f) == 1000*Second+f*FRAME);
+  REQUIRE(clock->localTimeOfFrame(f) <= now);
+  REQUIRE(clock->localTimeOfFrame(f+1) > now);
+  REQUIRE(clock->nextFrameStart(now) == clock->localTimeOfFrame(f+1));
+}
+
+
+TEST_CASE_METHOD(ClusterClockFixture, "offset estimate uses the beacon with the least delay", "[clusterclock]")
+{
+  MLMicroSeconds now = MainLoop::now();
+  MLMicroSeconds offset = 5000*Second;
+  // beacons sent every 100mS, received after 3, 1 and 7 mS
+  REQUIRE(beacon(now+offset, now+3*MilliSecond));
+  REQUIRE(beacon(now+offset+100*MilliSecond, now+101*MilliSecond));
+  REQUIRE(beacon(now+offset+200*MilliSecond, now+207*MilliSecond));
+  REQUIRE(clock->clusterTime(now) == now+offset-1*MilliSecond);
+  JsonObjectPtr s = clock->stats();
+  REQUIRE(s->get("beacons")->int64Value() == 3);
+  REQUIRE(s->get("jitter_us")->int64Value() == 6*MilliSecond);
+  // offset did not change with the last beacon
+  REQUIRE(changes == 2);
+}
+
+
+TEST_CASE_METHOD(ClusterClockFixture, "master restart discards old offset samples", "[clusterclock]")
+{
+  MLMicroSeconds now = MainLoop::now();
+  REQUIRE(beacon(now+5000*Second, now));
+  // new epoch: time base of the master has changed, smaller offset must be taken
+  REQUIRE(beacon(now+20*Second, now, 10*Second));
+  REQUIRE(clock->clusterTime(now) == now+20*Second);
+  REQUIRE(clock->clusterTimeOfFrame(0) == 10*Second);
+}
+
+
+TEST_CASE_METHOD(ClusterClockFixture, "invalid beacons are rejected", "[clusterclock]")
+{
+  MLMicroSeconds now = MainLoop::now();
+  MLMicroSeconds master = now+5000*Second;
+  // wrong size
+  string b = ClusterClock::beacon(1, master, 1000*Second, FRAME);
+  REQUIRE_FALSE(clock->processBeacon(b.data(), b.size()-1, now));
+  // wrong magic
+  b[0] ^= 0xFF;
+  REQUIRE_FALSE(clock->processBeacon(b.data(), b.size(), now));
+  // implausible values
+  REQUIRE_FALSE(beacon(master, now, 1000*Second, 0));
+  REQUIRE_FALSE(beacon(master, now, 1000*Second, -FRAME));
+  REQUIRE_FALSE(beacon(master, now, 1000*Second, 11*Second));
+  REQUIRE_FALSE(beacon(master, now, -1));
+  REQUIRE_FALSE(beacon(master, now, master+1));
+  REQUIRE_FALSE(clock->synchronized());
+  REQUIRE(changes == 0);
+  JsonObjectPtr s = clock->stats();
+  REQUIRE(s->get("rejected")->int64Value() == 5);
+  REQUIRE(s->get("beacons")->int64Value() == 0);
+  // still usable
+  REQUIRE(clock->frameAt(now) >= 0);
+}
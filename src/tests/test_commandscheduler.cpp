@@ -0,0 +1,168 @@
+//
+//  Copyright (c) 2026 plan44.ch / Lukas Zeller, Zurich, Switzerland
+//
+//  Author: Lukas Zeller <luz@plan44.ch>
+//
+//  This file is part of p44featured.
+//
+//  p44featured is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  p44featured is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with p44featured. If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "catch.hpp"
+
+#include "commandscheduler.hpp"
+
+#define FRAME (20*MilliSecond)
+
+using namespace p44;
+
+class SchedulerFixture
+{
+public:
+  ClusterClockPtr clock;
+  CommandSchedulerPtr scheduler;
+  std::vector<int> executed; ///< ids of executed requests, in execution order
+  std::vector<MLMicroSeconds> executedAt; ///< local time of execution
+  int errors;
+
+  SchedulerFixture() : errors(0) {}
+
+  /// @param aClock frame clock to use, NULL for none
+  void create(ClusterClockPtr aClock)
+  {
+    clock = aClock;
+    scheduler = CommandSchedulerPtr(new CommandScheduler(boost::bind(&SchedulerFixture::execute, this, _1, _2), clock));
+  }
+
+  void execute(JsonObjectPtr aRequest, RequestDoneCB aRequestDoneCB)
+  {
+    executed.push_back((int)aRequest->get("id")->int64Value());
+    executedAt.push_back(MainLoop::now());
+    if (aRequestDoneCB) aRequestDoneCB(JsonObjectPtr(), ErrorPtr());
+  }
+
+  void done(JsonObjectPtr aResponse, ErrorPtr aError)
+  {
+    if (Error::notOK(aError)) errors++;
+  }
+
+  ErrorPtr schedule(int aId, MLMicroSeconds aWhen, bool aAlign = false)
+  {
+    JsonObjectPtr r = JsonObject::newObj();
+    r->add("id", JsonObject::newInt64(aId));
+    return scheduler->schedule(r, boost::bind(&SchedulerFixture::done, this, _1, _2), aWhen, aAlign);
+  }
+
+  void run(MLMicroSeconds aDuration)
+  {
+    MainLoop::currentMainLoop().executeOnce(boost::bind(&MainLoop::terminate, &MainLoop::currentMainLoop(), EXIT_SUCCESS), aDuration);
+    MainLoop::currentMainLoop().run();
+  }
+
+  long stat(const char *aName)
+  {
+    return (long)scheduler->stats()->get(aName)->int64Value();
+  }
+};
+
+
+TEST_CASE_METHOD(SchedulerFixture, "requests execute in time order, equal times in arrival order", "[scheduler]")
+{
+  create(ClusterClockPtr());
+  MLMicroSeconds now = scheduler->clockTime();
+  REQUIRE(Error::isOK(schedule(1, now+30*MilliSecond)));
+  REQUIRE(Error::isOK(schedule(2, now+10*MilliSecond)));
+  REQUIRE(Error::isOK(schedule(3, now+30*MilliSecond)));
+  REQUIRE(Error::isOK(schedule(4, now+20*MilliSecond)));
+  REQUIRE(Error::isOK(schedule(5, now+30*MilliSecond)));
+  REQUIRE(scheduler->pending() == 5);
+  run(60*MilliSecond);
+  REQUIRE(executed.size() == 5);
+  REQUIRE(executed[0] == 2);
+  REQUIRE(executed[1] == 4);
+  REQUIRE(executed[2] == 1);
+  REQUIRE(executed[3] == 3);
+  REQUIRE(executed[4] == 5);
+  REQUIRE(executedAt[0] >= now+10*MilliSecond);
+  REQUIRE(executedAt[2] >= now+30*MilliSecond);
+  REQUIRE(scheduler->pending() == 0);
+  REQUIRE(stat("executed") == 5);
+}
+
+
+TEST_CASE_METHOD(SchedulerFixture, "aligned requests execute at the next frame start", "[scheduler]")
+{
+  create(ClusterClockPtr(new ClusterClock(true, "", 0, FRAME)));
+  MLMicroSeconds now = scheduler->clockTime();
+  int64_t f = clock->frameAt(now);
+  // within frame f+1: delayed to the start of f+2
+  REQUIRE(Error::isOK(schedule(1, clock->clusterTimeOfFrame(f+1)+5*MilliSecond, true)));
+  // exactly on the start of f+3: not delayed
+  REQUIRE(Error::isOK(schedule(2, clock->clusterTimeOfFrame(f+3), true)));
+  run(5*FRAME);
+  REQUIRE(executed.size() == 2);
+  REQUIRE(executedAt[0] >= clock->localTimeOfFrame(f+2));
+  REQUIRE(clock->frameAt(executedAt[0]) == f+2);
+  REQUIRE(executedAt[1] >= clock->localTimeOfFrame(f+3));
+  REQUIRE(clock->frameAt(executedAt[1]) == f+3);
+}
+
+
+TEST_CASE_METHOD(SchedulerFixture, "requests arriving too late execute right away and count as late", "[scheduler]")
+{
+  create(ClusterClockPtr());
+  MLMicroSeconds now = scheduler->clockTime();
+  REQUIRE(Error::isOK(schedule(1, now-10*MilliSecond)));
+  // executed synchronously
+  REQUIRE(executed.size() == 1);
+  REQUIRE(stat("late") == 1);
+  REQUIRE(stat("maxlateness_us") >= 10*MilliSecond);
+  REQUIRE(errors == 0);
+}
+
+
+TEST_CASE_METHOD(SchedulerFixture, "queue is limited, stop() reports errors for pending requests", "[scheduler]")
+{
+  create(ClusterClockPtr());
+  MLMicroSeconds later = scheduler->clockTime()+10*Second;
+  for (int i=0; i<1000; i++) {
+    REQUIRE(Error::isOK(schedule(i, later)));
+  }
+  ErrorPtr err = schedule(1000, later);
+  REQUIRE(Error::notOK(err));
+  REQUIRE(err->getErrorCode() == 503);
+  REQUIRE(scheduler->pending() == 1000);
+  scheduler->stop();
+  REQUIRE(scheduler->pending() == 0);
+  REQUIRE(errors == 1000);
+  REQUIRE(executed.empty());
+}
+
+
+TEST_CASE_METHOD(SchedulerFixture, "pending requests follow changes of the cluster offset", "[scheduler]")
+{
+  create(ClusterClockPtr(new ClusterClock(false, "239.255.44.1", 4401, FRAME)));
+  MLMicroSeconds start = MainLoop::now();
+  string b = ClusterClock::beacon(1, start+5000*Second, 1000*Second, FRAME);
+  REQUIRE(clock->processBeacon(b.data(), b.size(), start));
+  // due in 80mS cluster time
+  REQUIRE(Error::isOK(schedule(1, scheduler->clockTime()+80*MilliSecond)));
+  // better beacon: cluster time is 50mS later than estimated, so the request is due 50mS earlier
+  b = ClusterClock::beacon(2, start+5000*Second+50*MilliSecond, 1000*Second, FRAME);
+  REQUIRE(clock->processBeacon(b.data(), b.size(), start));
+  run(100*MilliSecond);
+  REQUIRE(executed.size() == 1);
+  REQUIRE(executedAt[0] >= start+30*MilliSecond);
+  REQUIRE(executedAt[0] < start+70*MilliSecond);
+}
@@ -0,0 +1,62 @@
+//
+//  Copyright (c) 2026 plan44.ch / Lukas Zeller, Zurich, Switzerland
+//
+//  Author: Lukas Zeller <luz@plan44.ch>
+//
+//  This file is part of p44featured.
+//
+//  p44featured is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  p44featured is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with p44featured. If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "catch.hpp"
+
+#include "inlinecb.hpp"
+
+using namespace p44;
+
+
+TEST_CASE("CallbackSlots reuse slots", "[inlinecb]")
+{
+  CallbackSlots<string> slots;
+  int a = slots.put("a");
+  int b = slots.put("b");
+  REQUIRE(slots.pending() == 2);
+  REQUIRE(slots.take(a) == "a");
+  REQUIRE(slots.pending() == 1);
+  int c = slots.put("c");
+  REQUIRE(c != a); // same slot, but new generation
+  REQUIRE(slots.pending() == 2);
+  REQUIRE(slots.take(c) == "c");
+  REQUIRE(slots.take(b) == "b");
+  REQUIRE(slots.pending() == 0);
+}
+
+
+TEST_CASE("CallbackSlots reject stale and invalid handles", "[inlinecb]")
+{
+  CallbackSlots<string> slots;
+  int a = slots.put("a");
+  REQUIRE(slots.take(a) == "a");
+  // taken twice
+  REQUIRE(slots.take(a) == "");
+  // late, after the slot was reused
+  int b = slots.put("b");
+  REQUIRE(slots.take(a) == "");
+  REQUIRE(slots.pending() == 1);
+  REQUIRE(slots.take(b) == "b");
+  // never issued
+  REQUIRE(slots.take(-1) == "");
+  REQUIRE(slots.take(12345) == "");
+  REQUIRE(slots.pending() == 0);
+}
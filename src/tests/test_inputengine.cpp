@@ -0,0 +1,137 @@
+//
+//  Copyright (c) 2026 plan44.ch / Lukas Zeller, Zurich, Switzerland
+//
+//  Author: Lukas Zeller <luz@plan44.ch>
+//
+//  This file is part of p44featured.
+//
+//  p44featured is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  p44featured is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with p44featured. If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "catch.hpp"
+
+#include "inputengine.hpp"
+
+#define DEBOUNCE (20*MilliSecond)
+
+using namespace p44;
+
+class InputEngineFixture
+{
+public:
+  InputEnginePtr engine;
+  std::vector<std::pair<int, bool> > edges;
+  MLMicroSeconds startedAt;
+
+  InputEngineFixture() : engine(new InputEngine(DEBOUNCE)), startedAt(Never) {}
+
+  void edge(int aLineId, bool aState, MLMicroSeconds aTimestamp)
+  {
+    edges.push_back(std::make_pair(aLineId, aState));
+  }
+
+  int addSim(const string aPinSpec)
+  {
+    int lineId = -1;
+    ErrorPtr err = engine->addInput(aPinSpec, boost::bind(&InputEngineFixture::edge, this, _1, _2, _3), lineId);
+    REQUIRE(Error::isOK(err));
+    return lineId;
+  }
+
+  /// simulate a raw edge at aAt after start
+  void edgeAt(int aLineId, bool aRawState, MLMicroSeconds aAt)
+  {
+    MainLoop::currentMainLoop().executeOnce(boost::bind(&InputEngine::simulateEdge, engine.get(), aLineId, aRawState), aAt);
+  }
+
+  /// start the engine and run the mainloop for aDuration
+  void run(MLMicroSeconds aDuration)
+  {
+    REQUIRE(Error::isOK(engine->start()));
+    MainLoop::currentMainLoop().executeOnce(boost::bind(&MainLoop::terminate, &MainLoop::currentMainLoop(), EXIT_SUCCESS), aDuration);
+    MainLoop::currentMainLoop().run();
+    engine->stop();
+  }
+};
+
+
+TEST_CASE_METHOD(InputEngineFixture, "initial state is reported once at start", "[inputengine]")
+{
+  int a = addSim("sim.a");
+  int b = addSim("/sim.b");
+  run(10*MilliSecond);
+  REQUIRE(edges.size() == 2);
+  REQUIRE(edges[0] == std::make_pair(a, false));
+  REQUIRE(edges[1] == std::make_pair(b, true)); // inverted
+  REQUIRE(engine->state(b));
+}
+
+
+TEST_CASE_METHOD(InputEngineFixture, "leading edge is reported, bouncing is ignored", "[inputengine]")
+{
+  int a = addSim("sim.a");
+  edgeAt(a, true, 10*MilliSecond);
+  edgeAt(a, false, 12*MilliSecond);
+  edgeAt(a, true, 14*MilliSecond);
+  run(100*MilliSecond);
+  // bounces settled in the reported state: nothing more to report
+  REQUIRE(edges.size() == 2);
+  REQUIRE(edges[1] == std::make_pair(a, true));
+  REQUIRE(engine->state(a));
+}
+
+
+TEST_CASE_METHOD(InputEngineFixture, "release within dead time is reported when dead time ends", "[inputengine]")
+{
+  int a = addSim("sim.a");
+  edgeAt(a, true, 10*MilliSecond);
+  edgeAt(a, false, 12*MilliSecond);
+  edgeAt(a, true, 14*MilliSecond);
+  edgeAt(a, false, 16*MilliSecond);
+  run(100*MilliSecond);
+  // short press is never lost, and the bouncing coalesces into one press/release pair
+  REQUIRE(edges.size() == 3);
+  REQUIRE(edges[1] == std::make_pair(a, true));
+  REQUIRE(edges[2] == std::make_pair(a, false));
+  REQUIRE_FALSE(engine->state(a));
+}
+
+
+TEST_CASE_METHOD(InputEngineFixture, "lines are debounced independently", "[inputengine]")
+{
+  int a = addSim("sim.a");
+  int b = addSim("sim.b");
+  edgeAt(a, true, 10*MilliSecond);
+  edgeAt(b, true, 12*MilliSecond); // within a's dead time, but b is not debouncing
+  edgeAt(a, false, 40*MilliSecond); // after a's dead time
+  run(100*MilliSecond);
+  REQUIRE(edges.size() == 5);
+  REQUIRE(edges[2] == std::make_pair(a, true));
+  REQUIRE(edges[3] == std::make_pair(b, true));
+  REQUIRE(edges[4] == std::make_pair(a, false));
+}
+
+
+TEST_CASE_METHOD(InputEngineFixture, "pinspec checks", "[inputengine]")
+{
+  int lineId;
+  REQUIRE(Error::notOK(engine->addInput("nobus", InputEdgeCB(), lineId)));
+  REQUIRE(Error::notOK(engine->addInput("unknown.1", InputEdgeCB(), lineId)));
+  REQUIRE(Error::notOK(engine->addInput("gpio.x", InputEdgeCB(), lineId)));
+  // only simulated lines can be driven by simulateEdge()
+  REQUIRE(Error::isOK(engine->addInput("gpio.5", boost::bind(&InputEngineFixture::edge, this, _1, _2, _3), lineId)));
+  engine->simulateEdge(lineId, true);
+  REQUIRE(edges.empty());
+  REQUIRE(engine->numLines() == 1);
+}
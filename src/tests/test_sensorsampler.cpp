@@ -0,0 +1,128 @@
+//
+//  Copyright (c) 2026 plan44.ch / Lukas Zeller, Zurich, Switzerland
+//
+//  Author: Lukas Zeller <luz@plan44.ch>
+//
+//  This file is part of p44featured.
+//
+//  p44featured is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  p44featured is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with p44featured. If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "catch.hpp"
+
+#include "sensorsampler.hpp"
+
+using namespace p44;
+
+struct CrossingRecord {
+  int channel;
+  bool above;
+  double average;
+  MLMicroSeconds when;
+};
+
+class SamplerFixture
+{
+public:
+  SensorSamplerPtr sampler;
+  std::vector<CrossingRecord> crossings;
+  MLMicroSeconds t;
+
+  SamplerFixture() : t(0) {}
+
+  void crossed(int aChannel, bool aAbove, double aAverage, MLMicroSeconds aWhen)
+  {
+    CrossingRecord c = { aChannel, aAbove, aAverage, aWhen };
+    crossings.push_back(c);
+  }
+
+  /// feed one value per channel, as a block of 1
+  void feed(double aV0, double aV1 = 0)
+  {
+    double s[2] = { aV0, aV1 };
+    t += 10*MilliSecond;
+    sampler->processSamples(s, &t, boost::bind(&SamplerFixture::crossed, this, _1, _2, _3, _4));
+  }
+};
+
+
+TEST_CASE_METHOD(SamplerFixture, "moving average over partial and full window", "[sensorsampler]")
+{
+  sampler = SensorSamplerPtr(new SensorSampler(100, 1));
+  sampler->addChannel(AnalogIoPtr(), 4, 1000);
+  feed(2);
+  REQUIRE(sampler->average(0) == Approx(2));
+  feed(4);
+  REQUIRE(sampler->average(0) == Approx(3)); // only filled samples count
+  feed(6); feed(8);
+  REQUIRE(sampler->average(0) == Approx(5));
+  feed(10); // replaces the 2
+  REQUIRE(sampler->average(0) == Approx(7));
+  REQUIRE(sampler->average(1) == 0); // nonexistent channel
+}
+
+
+TEST_CASE_METHOD(SamplerFixture, "running sum does not drift over many window wraps", "[sensorsampler]")
+{
+  sampler = SensorSamplerPtr(new SensorSampler(100, 1));
+  sampler->addChannel(AnalogIoPtr(), 3, 1e30);
+  // large values followed by small ones make a naive running sum lose the small values
+  for (int i=0; i<3; i++) feed(1e16);
+  for (int i=0; i<1000; i++) feed(0.1*(i%3+1)); // 0.1, 0.2, 0.3 repeating
+  REQUIRE(sampler->average(0) == Approx(0.2).epsilon(1e-9));
+}
+
+
+TEST_CASE_METHOD(SamplerFixture, "threshold crossings with hysteresis", "[sensorsampler]")
+{
+  sampler = SensorSamplerPtr(new SensorSampler(100, 1));
+  sampler->addChannel(AnalogIoPtr(), 1, 10, 2);
+  feed(5);
+  REQUIRE(crossings.empty());
+  feed(11);
+  REQUIRE(crossings.size() == 1);
+  REQUIRE(crossings[0].above);
+  REQUIRE(crossings[0].when == t);
+  feed(9); // below threshold, but within hysteresis
+  REQUIRE(crossings.size() == 1);
+  feed(7.5);
+  REQUIRE(crossings.size() == 2);
+  REQUIRE_FALSE(crossings[1].above);
+  REQUIRE(crossings[1].average == Approx(7.5));
+}
+
+
+TEST_CASE_METHOD(SamplerFixture, "blocks are processed per channel in sample order", "[sensorsampler]")
+{
+  sampler = SensorSamplerPtr(new SensorSampler(100, 3));
+  sampler->addChannel(AnalogIoPtr(), 2, 5);
+  sampler->addChannel(AnalogIoPtr(), 2, 50);
+  // channel-interleaved: (ch0, ch1) per sample period
+  double s[6] = { 1, 100, 9, 0, 20, 0 };
+  MLMicroSeconds times[3] = { 1000, 2000, 3000 };
+  sampler->processSamples(s, times, boost::bind(&SamplerFixture::crossed, this, _1, _2, _3, _4));
+  REQUIRE(sampler->average(0) == Approx(14.5));
+  REQUIRE(sampler->average(1) == Approx(0));
+  REQUIRE(crossings.size() == 3);
+  // channel 0 rises with the third sample (avg 5 is not above 5, avg 14.5 is)...
+  REQUIRE(crossings[0].channel == 0);
+  REQUIRE(crossings[0].when == 3000);
+  // ...channel 1 rises with the first sample, and falls when the average drops below 50 with the third
+  REQUIRE(crossings[1].channel == 1);
+  REQUIRE(crossings[1].above);
+  REQUIRE(crossings[1].when == 1000);
+  REQUIRE(crossings[2].channel == 1);
+  REQUIRE_FALSE(crossings[2].above);
+  REQUIRE(crossings[2].when == 3000);
+}
@@ -0,0 +1,156 @@
+//
+//  Copyright (c) 2026 plan44.ch / Lukas Zeller, Zurich, Switzerland
+//
+//  Author: Lukas Zeller <luz@plan44.ch>
+//
+//  This file is part of p44featured.
+//
+//  p44featured is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  p44featured is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with p44featured. If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "catch.hpp"
+
+#include "statesnapshot.hpp"
+
+#include <unistd.h>
+
+using namespace p44;
+
+class SnapshotFixture
+{
+public:
+
+  char path[32];
+  string order; ///< sequence of apply callbacks, like "F:light F:hermel V V:x"
+  JsonObjectPtr features;
+  JsonObjectPtr view;
+  JsonObjectPtr vars;
+
+  SnapshotFixture() :
+    features(JsonObject::newObj()),
+    vars(JsonObject::newObj())
+  {
+    strcpy(path, "/tmp/snapshot_test_XXXXXX");
+    int fd = mkstemp(path);
+    if (fd>=0) close(fd);
+  }
+
+  ~SnapshotFixture()
+  {
+    unlink(path);
+  }
+
+  void apply(StateSnapshot &aSnapshot)
+  {
+    aSnapshot.apply(
+      boost::bind(&SnapshotFixture::featureRestored, this, _1, _2),
+      boost::bind(&SnapshotFixture::viewRestored, this, _1),
+      boost::bind(&SnapshotFixture::varRestored, this, _1, _2)
+    );
+  }
+
+  void featureRestored(const string aFeatureName, JsonObjectPtr aInitRequest)
+  {
+    order += " F:" + aFeatureName;
+    features->add(aFeatureName.c_str(), aInitRequest);
+  }
+
+  void viewRestored(JsonObjectPtr aViewStatus)
+  {
+    order += " V";
+    view = aViewStatus;
+  }
+
+  void varRestored(const string aVarName, JsonObjectPtr aValue)
+  {
+    order += " V:" + aVarName;
+    vars->add(aVarName.c_str(), aValue);
+  }
+
+};
+
+
+static JsonObjectPtr initRequest(const char *aFeature, int aParam)
+{
+  JsonObjectPtr r = JsonObject::newObj();
+  r->add("feature", JsonObject::newString(aFeature));
+  r->add("cmd", JsonObject::newString("init"));
+  r->add("param", JsonObject::newInt64(aParam));
+  return r;
+}
+
+
+TEST_CASE_METHOD(SnapshotFixture, "snapshot round trips through the file and is re-applied in order", "[snapshot]")
+{
+  StateSnapshot saved(path);
+  saved.recordInit("light", initRequest("light", 1));
+  saved.recordInit("hermel", initRequest("hermel", 2));
+  saved.recordInit("light", initRequest("light", 3)); // latest init wins
+  JsonObjectPtr viewStatus = JsonObject::newObj();
+  viewStatus->add("type", JsonObject::newString("stack"));
+  viewStatus->add("x", JsonObject::newInt64(-4));
+  JsonObjectPtr savedVars = JsonObject::newObj();
+  savedVars->add("mode", JsonObject::newString("night"));
+  savedVars->add("level", JsonObject::newDouble(0.5));
+  REQUIRE(Error::isOK(saved.save(viewStatus, savedVars)));
+
+  StateSnapshot restored(path);
+  REQUIRE(!restored.restorePending());
+  REQUIRE(Error::isOK(restored.load()));
+  REQUIRE(restored.restorePending());
+  apply(restored);
+  // features first, then the view, then the variables
+  REQUIRE(order == " F:light F:hermel V V:mode V:level");
+  REQUIRE(features->get("light")->json_str() == initRequest("light", 3)->json_str());
+  REQUIRE(features->get("hermel")->json_str() == initRequest("hermel", 2)->json_str());
+  REQUIRE(view);
+  REQUIRE(view->json_str() == viewStatus->json_str());
+  REQUIRE(vars->json_str() == savedVars->json_str());
+  // applied only once
+  REQUIRE(!restored.restorePending());
+  order.clear();
+  apply(restored);
+  REQUIRE(order.empty());
+}
+
+
+TEST_CASE_METHOD(SnapshotFixture, "snapshot without view and variables", "[snapshot]")
+{
+  StateSnapshot saved(path);
+  saved.recordInit("splitflaps", initRequest("splitflaps", 7));
+  REQUIRE(Error::isOK(saved.save(JsonObjectPtr(), JsonObjectPtr())));
+  StateSnapshot restored(path);
+  REQUIRE(Error::isOK(restored.load()));
+  apply(restored);
+  REQUIRE(order == " F:splitflaps");
+  REQUIRE(!view);
+}
+
+
+TEST_CASE_METHOD(SnapshotFixture, "invalid snapshot files are not applied", "[snapshot]")
+{
+  StateSnapshot restored(path);
+  // empty file
+  REQUIRE(Error::notOK(restored.load()));
+  REQUIRE(!restored.restorePending());
+  // not a binary JSON file
+  string_tofile(path, "{\"features\":{}}");
+  REQUIRE(Error::notOK(restored.load()));
+  REQUIRE(!restored.restorePending());
+  // missing file
+  unlink(path);
+  REQUIRE(Error::notOK(restored.load()));
+  apply(restored);
+  REQUIRE(order.empty());
+}